@@ -7,10 +7,17 @@
 #include <malloc.h>
 #endif
 #include <math.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#define BIG_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(JANET_WINDOWS)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
 #include "libbf.h"
 
-static bf_context_t bf_ctx; // is this ok?  threads? &&&
-
 static void *big_bf_realloc(void *opaque, void *ptr, size_t size) {
   (void) opaque;
   // All libbf internal allocations and frees go through this point.
@@ -37,13 +44,289 @@ static void *big_bf_realloc(void *opaque, void *ptr, size_t size) {
   return new_alloc;
 }
 
+static void *big_bf_realloc_nogc(void *opaque, void *ptr, size_t size) {
+  (void) opaque;
+  return realloc(ptr, size);
+}
+
+// Each OS thread gets its own libbf context, since the context owns the
+// NTT trig tables, the radix conversion powers and the log2/pi constant
+// caches which are not safe to share.  Janet values never cross threads
+// without being marshalled, so every bf_t only ever sees the context of
+// the thread that created it.
+// The state is created lazily on first use and freed when the thread
+// exits.
+typedef struct {
+  bf_context_t ctx;
+  // destination for the in-place operations, see big_int_update
+  bf_inline_t scratch;
+} big_state_t;
+
+static JANET_THREAD_LOCAL big_state_t *big_tls_state = NULL;
+
+static void big_state_free(void *p) {
+  big_state_t *st = (big_state_t *) p;
+  if (st == NULL)
+    return;
+  // The janet vm of this thread may already be gone, so don't report
+  // these frees as gc pressure.
+  st->ctx.realloc_func = big_bf_realloc_nogc;
+  bf_delete(&st->scratch.b);
+  bf_context_end(&st->ctx);
+  free(st);
+}
+
+#if defined(JANET_WINDOWS)
+
+static INIT_ONCE big_state_once = INIT_ONCE_STATIC_INIT;
+static DWORD big_state_key = FLS_OUT_OF_INDEXES;
+
+static void WINAPI big_state_fls_free(void *p) {
+  big_state_free(p);
+}
+
+static BOOL CALLBACK big_state_key_init(PINIT_ONCE once, PVOID param, PVOID *out) {
+  (void) once;
+  (void) param;
+  (void) out;
+  big_state_key = FlsAlloc(big_state_fls_free);
+  return big_state_key != FLS_OUT_OF_INDEXES;
+}
+
+static void big_state_register(big_state_t *st) {
+  if (!InitOnceExecuteOnce(&big_state_once, big_state_key_init, NULL, NULL))
+    janet_panic("unable to allocate big/int thread context key");
+  FlsSetValue(big_state_key, st);
+}
+
+#else
+
+static pthread_once_t big_state_once = PTHREAD_ONCE_INIT;
+static pthread_key_t big_state_key;
+static int big_state_key_ok = 0;
+
+static void big_state_key_init(void) {
+  big_state_key_ok = (pthread_key_create(&big_state_key, big_state_free) == 0);
+}
+
+static void big_state_register(big_state_t *st) {
+  pthread_once(&big_state_once, big_state_key_init);
+  if (!big_state_key_ok)
+    janet_panic("unable to allocate big/int thread context key");
+  pthread_setspecific(big_state_key, st);
+}
+
+#endif
+
+// Optional worker pool for the NTT multiplication of very large
+// big/ints, configured with big/set-threads.  libbf hands it the
+// independent per-modulus convolutions of one product; the tasks only
+// touch memory that was allocated up front, never the janet vm.  The
+// pool is shared by all threads: a product that finds it busy runs its
+// tasks on the calling thread instead.
+
+#define BIG_POOL_MAX_THREADS 64
+#define BIG_POOL_DEFAULT_MIN_LIMBS 20000
+
+#if defined(JANET_WINDOWS)
+typedef SRWLOCK big_mutex_t;
+typedef CONDITION_VARIABLE big_cond_t;
+typedef HANDLE big_thread_t;
+#define BIG_MUTEX_INIT SRWLOCK_INIT
+#define BIG_COND_INIT CONDITION_VARIABLE_INIT
+#define big_mutex_lock(m) AcquireSRWLockExclusive(m)
+#define big_mutex_unlock(m) ReleaseSRWLockExclusive(m)
+#define big_cond_wait(c, m) SleepConditionVariableSRW((c), (m), INFINITE, 0)
+#define big_cond_broadcast(c) WakeAllConditionVariable(c)
+#define big_atomic_load(p) InterlockedCompareExchange64((p), 0, 0)
+#define big_atomic_store(p, v) InterlockedExchange64((p), (v))
+#else
+typedef pthread_mutex_t big_mutex_t;
+typedef pthread_cond_t big_cond_t;
+typedef pthread_t big_thread_t;
+#define BIG_MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+#define BIG_COND_INIT PTHREAD_COND_INITIALIZER
+#define big_mutex_lock(m) pthread_mutex_lock(m)
+#define big_mutex_unlock(m) pthread_mutex_unlock(m)
+#define big_cond_wait(c, m) pthread_cond_wait((c), (m))
+#define big_cond_broadcast(c) pthread_cond_broadcast(c)
+#define big_atomic_load(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#define big_atomic_store(p, v) __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#endif
+
+static struct {
+  big_mutex_t lock;
+  big_cond_t work; // tasks were posted, or the workers must stop
+  big_cond_t done; // the current job finished
+  big_thread_t threads[BIG_POOL_MAX_THREADS];
+  int nworkers;
+  int stop;
+  int busy; // a job is running or the pool is being resized
+  limb_t min_limbs;
+  // min_limbs + 1 when there are workers, else 0: read without the lock
+  // on every product, so that the size check costs no locking
+  volatile int64_t dispatch_limbs;
+  // current job
+  bf_parallel_task_func_t *func;
+  void *arg;
+  int n, next, pending;
+} big_pool = {
+  BIG_MUTEX_INIT, BIG_COND_INIT, BIG_COND_INIT,
+  {0}, 0, 0, 0, BIG_POOL_DEFAULT_MIN_LIMBS, 0,
+  NULL, NULL, 0, 0, 0
+};
+
+// Run the unclaimed tasks of the current job, called with the lock held.
+static void big_pool_work(void) {
+  while (big_pool.next < big_pool.n) {
+    int i = big_pool.next++;
+    big_mutex_unlock(&big_pool.lock);
+    big_pool.func(big_pool.arg, i);
+    big_mutex_lock(&big_pool.lock);
+    if (--big_pool.pending == 0)
+      big_cond_broadcast(&big_pool.done);
+  }
+}
+
+#if defined(JANET_WINDOWS)
+static DWORD WINAPI big_pool_worker(LPVOID param) {
+#else
+static void *big_pool_worker(void *param) {
+#endif
+  (void) param;
+  big_mutex_lock(&big_pool.lock);
+  for (;;) {
+    while (!big_pool.stop && big_pool.next >= big_pool.n)
+      big_cond_wait(&big_pool.work, &big_pool.lock);
+    if (big_pool.stop)
+      break;
+    big_pool_work();
+  }
+  big_mutex_unlock(&big_pool.lock);
+  return 0;
+}
+
+static int big_pool_use(void *opaque, limb_t len) {
+  (void) opaque;
+  // a stale value only means one product runs on the calling thread,
+  // or reaches big_pool_run, which checks again under the lock
+  int64_t d = big_atomic_load(&big_pool.dispatch_limbs);
+  return d != 0 && (int64_t) len >= d - 1;
+}
+
+static void big_pool_run(void *opaque, bf_parallel_task_func_t *func,
+                         void *arg, int n) {
+  (void) opaque;
+  big_mutex_lock(&big_pool.lock);
+  if (big_pool.busy || big_pool.nworkers == 0) {
+    big_mutex_unlock(&big_pool.lock);
+    for (int i = 0; i < n; i++)
+      func(arg, i);
+    return;
+  }
+  big_pool.busy = 1;
+  big_pool.func = func;
+  big_pool.arg = arg;
+  big_pool.n = n;
+  big_pool.next = 0;
+  big_pool.pending = n;
+  big_cond_broadcast(&big_pool.work);
+  big_pool_work();
+  while (big_pool.pending > 0)
+    big_cond_wait(&big_pool.done, &big_pool.lock);
+  big_pool.n = big_pool.next = 0;
+  big_pool.busy = 0;
+  big_cond_broadcast(&big_pool.done);
+  big_mutex_unlock(&big_pool.lock);
+}
+
+static const bf_parallel_t big_parallel = {
+  big_pool_use, big_pool_run, NULL
+};
+
+// Replace the workers by nthreads - 1 new ones and return how many
+// could be started.
+static int big_pool_resize(int nthreads, limb_t min_limbs) {
+  big_mutex_lock(&big_pool.lock);
+  while (big_pool.busy)
+    big_cond_wait(&big_pool.done, &big_pool.lock);
+  big_pool.busy = 1;
+  big_pool.stop = 1;
+  big_atomic_store(&big_pool.dispatch_limbs, 0);
+  big_cond_broadcast(&big_pool.work);
+  int old = big_pool.nworkers;
+  big_mutex_unlock(&big_pool.lock);
+  for (int i = 0; i < old; i++) {
+#if defined(JANET_WINDOWS)
+    WaitForSingleObject(big_pool.threads[i], INFINITE);
+    CloseHandle(big_pool.threads[i]);
+#else
+    pthread_join(big_pool.threads[i], NULL);
+#endif
+  }
+  big_mutex_lock(&big_pool.lock);
+  big_pool.stop = 0;
+  big_pool.nworkers = 0;
+  big_pool.min_limbs = min_limbs;
+  while (big_pool.nworkers < nthreads - 1) {
+    big_thread_t *t = &big_pool.threads[big_pool.nworkers];
+#if defined(JANET_WINDOWS)
+    *t = CreateThread(NULL, 0, big_pool_worker, NULL, 0, NULL);
+    if (*t == NULL)
+      break;
+#else
+    if (pthread_create(t, NULL, big_pool_worker, NULL))
+      break;
+#endif
+    big_pool.nworkers++;
+  }
+  int started = big_pool.nworkers;
+  big_atomic_store(&big_pool.dispatch_limbs,
+                   started > 0 ? (int64_t) min_limbs + 1 : 0);
+  big_pool.busy = 0;
+  big_cond_broadcast(&big_pool.done);
+  big_mutex_unlock(&big_pool.lock);
+  return started;
+}
+
+static big_state_t *big_state(void) {
+  big_state_t *st = big_tls_state;
+  if (st != NULL)
+    return st;
+  st = malloc(sizeof(big_state_t));
+  if (st == NULL)
+    janet_panic("out of memory allocating big/int context");
+  bf_context_init(&st->ctx, big_bf_realloc, NULL);
+  st->ctx.parallel = &big_parallel;
+  bf_init_inline(&st->ctx, &st->scratch);
+  big_state_register(st);
+  big_tls_state = st;
+  return st;
+}
+
+static bf_context_t *big_ctx(void) {
+  return &big_state()->ctx;
+}
+
 static int big_int_get(void *p, Janet key, Janet *out);
 
+// The payload of a big/int abstract.  The hash is computed the first time
+// the big/int is hashed and kept until an in-place update changes the
+// value, so a big/int used as a table key is only hashed once.  A table
+// doesn't rehash its keys, so updating a big/int in place while it is a
+// key leaves it in the wrong bucket; the in-place functions document
+// this.
+typedef struct {
+  bf_inline_t bi;
+  int32_t hash;
+  int hash_ok;
+} big_int_t;
+
 // Any bf_t that gets wrapped into a Janet will get automatically
-// bf_delete on gc.  This means you must make sure you bf_init any
-// bf_t that has been wrapped in a Janet, but also that you do not
-// have to bf_delete any bf_t that has been wrapped in a Janet as
-// the GC will handle it.
+// bf_delete on gc.  This means you must make sure any bf_t that has
+// been wrapped in a Janet was created with big_int_alloc (or
+// bf_init_inline'd), but also that you do not have to bf_delete any
+// bf_t that has been wrapped in a Janet as the GC will handle it.
 static int big_int_gc(void *p, size_t len) {
   (void)len;
   bf_t *b = (bf_t *)p;
@@ -51,45 +334,98 @@ static int big_int_gc(void *p, size_t len) {
   return 0;
 }
 
-static char *big_digits(bf_t *b, size_t *size) {
-  size_t sz;
-  //size_t prec = b->len * LIMB_BITS; // &&& correct? too high?
-  //char *digits = bf_ftoa(&sz, b, 10, prec, BF_RNDN | BF_FTOA_FORMAT_FREE_MIN);
-  char *digits = bf_ftoa(&sz, b, 10, 0, BF_RNDZ | BF_FTOA_FORMAT_FRAC);
-  if (size != NULL)
-    *size = sz;
-  return digits;
+// LIMB_BITS bits of the mantissa of b from bit pos, zero outside of it
+static limb_t big_get_bits(const bf_t *b, slimb_t pos) {
+  slimb_t i = pos >> LIMB_LOG2_BITS;
+  int shift = pos & (LIMB_BITS - 1);
+  limb_t a0 = (i >= 0 && i < (slimb_t) b->len) ? b->tab[i] : 0;
+  if (shift == 0)
+    return a0;
+  limb_t a1 = (i + 1 >= 0 && i + 1 < (slimb_t) b->len) ? b->tab[i + 1] : 0;
+  return (a0 >> shift) | (a1 << (LIMB_BITS - shift));
+}
+
+// Number of characters of b written in radix, or -1 if it does not fit
+// a janet string.  The other radixes than powers of two need digits to
+// hold b converted to radix limbs, which give the exact digit count.
+static int32_t big_radix_length(const bf_t *b, int radix, bf_t *digits) {
+  limb_t n;
+  if ((radix & (radix - 1)) == 0) {
+    int bits = __builtin_ctz(radix);
+    n = bf_is_zero(b) ? 1 : ((limb_t) b->expn + bits - 1) / bits;
+  } else {
+    n = bf_get_radix_limbs(digits, b, radix);
+    if (n == 0)
+      return -1;
+  }
+  if (n > (limb_t) INT32_MAX - 1)
+    return -1;
+  // zero may carry a sign, but is never written with one
+  return (int32_t) n + (b->sign && !bf_is_zero(b));
+}
+
+// Write the len characters of b counted by big_radix_length to out.
+static void big_radix_write(char *out, const bf_t *b, int radix,
+                            const bf_t *digits, int32_t len) {
+  if (b->sign && !bf_is_zero(b)) {
+    *out++ = '-';
+    len--;
+  }
+  if ((radix & (radix - 1)) != 0) {
+    bf_radix_limbs_to_str(out, digits, len, radix);
+  } else if (bf_is_zero(b)) {
+    out[0] = '0';
+  } else {
+    // the digits are groups of bits of the integer, whose bit 0 is at
+    // position offset of the mantissa (negative when the low limbs are
+    // zero and not stored)
+    int bits = __builtin_ctz(radix);
+    slimb_t offset = (slimb_t) (b->len * LIMB_BITS) - b->expn;
+    for (int32_t i = 0; i < len; i++) {
+      limb_t v = big_get_bits(b, offset + (slimb_t) (len - 1 - i) * bits);
+      out[i] = "0123456789abcdefghijklmnopqrstuv"[v & (radix - 1)];
+    }
+  }
 }
 
 static void big_int_to_string(void *p, JanetBuffer *buf) {
   bf_t *b = (bf_t *) p;
-  size_t sz;
-  char *digits = big_digits(b, &sz);
-  if (digits == NULL)
+  bf_t digits;
+  // the exact length is known before any character is written, so the
+  // digits go straight into buf
+  bf_init(b->ctx, &digits);
+  int32_t len = big_radix_length(b, 10, &digits);
+  if (len < 0 || len > INT32_MAX - buf->count) {
+    bf_delete(&digits);
     janet_panic("unable to convert big/int to string");
-  janet_buffer_push_cstring(buf, digits);
-  bf_free(&bf_ctx, digits);
+  }
+  janet_buffer_extra(buf, len);
+  big_radix_write((char *) buf->data + buf->count, b, 10, &digits, len);
+  buf->count += len;
+  bf_delete(&digits);
 }
 
-static uint32_t hash_add_int64(uint32_t hash, uint64_t v) {
-  char *p = (char *) &v;
-  for (size_t i = 0; i < 8; i++) {
-    hash = (hash << 5) + hash + *(p + i);
-  }
-  return hash;
+// One multiply and shift per limb, so that long values hash at memory
+// speed.
+static uint64_t big_hash_mix(uint64_t h, uint64_t v) {
+  h = (h ^ v) * UINT64_C(0x9e3779b97f4a7c15);
+  return h ^ (h >> 29);
 }
 
 static int32_t big_int_hash(void *p, size_t size) {
   (void) size;
-  bf_t *b = (bf_t *)p;
-  uint32_t hash = 5381;
-  hash = (hash << 5) + hash + b->sign; // 1 for negative, else 0
-  // assumes LIMB_BITS = 64 -- see preprocessor #error line above
-  hash = hash_add_int64(hash, b->expn);
-  for (size_t i = 0; i < b->len; i++) {
-    hash = hash_add_int64(hash, b->tab[i]);
-  }
-  return (int32_t)hash;
+  big_int_t *x = (big_int_t *) p;
+  if (x->hash_ok)
+    return x->hash;
+  bf_t *b = &x->bi.b;
+  // zero may carry either sign, but both compare equal
+  uint64_t h = bf_is_zero(b) ? 0 : (uint64_t) b->sign;
+  h = big_hash_mix(h, (uint64_t) b->expn);
+  for (limb_t i = 0; i < b->len; i++)
+    h = big_hash_mix(h, b->tab[i]);
+  x->hash = (int32_t) (h ^ (h >> 32));
+  x->hash_ok = 1;
+  return x->hash;
 }
 
 static int big_int_compare(void *p1, void *p2) {
@@ -98,91 +434,286 @@ static int big_int_compare(void *p1, void *p2) {
   return bf_cmp(x, y);
 }
 
+// big/ints are marshalled in a binary form: the raw libbf mantissa limbs
+// (as little-endian 64 bit words) plus sign and exponent, so no radix
+// conversion is needed in either direction.  The legacy form was a
+// janet_marshal_size() byte count followed by a zero terminated decimal
+// string, and that count was always >= 1, so a leading size of 0 marks the
+// binary form and is followed by a version byte.
+#define BIG_MARSHAL_BINARY 0
+#define BIG_MARSHAL_VERSION 1
+
+static void big_int_marshal_value(const bf_t *b, JanetMarshalContext *ctx) {
+  janet_marshal_size(ctx, BIG_MARSHAL_BINARY);
+  janet_marshal_byte(ctx, BIG_MARSHAL_VERSION);
+  janet_marshal_byte(ctx, (uint8_t) b->sign);
+  janet_marshal_int64(ctx, (int64_t) b->expn);
+#if LIMB_BITS == 64
+  janet_marshal_size(ctx, b->len);
+#if defined(JANET_LITTLE_ENDIAN)
+  janet_marshal_bytes(ctx, (const uint8_t *) b->tab, b->len * sizeof(limb_t));
+#else
+  for (size_t i = 0; i < b->len; i++)
+    janet_marshal_int64(ctx, (int64_t) b->tab[i]);
+#endif
+#else
+  // pad an odd limb count with a zero low limb to whole 64 bit words
+  size_t nwords = (b->len + 1) / 2;
+  size_t pad = nwords * 2 - b->len;
+  janet_marshal_size(ctx, nwords);
+  for (size_t i = 0; i < nwords; i++) {
+    uint64_t lo = (2 * i < pad) ? 0 : b->tab[2 * i - pad];
+    uint64_t hi = b->tab[2 * i + 1 - pad];
+    janet_marshal_int64(ctx, (int64_t) (lo | (hi << 32)));
+  }
+#endif
+}
+
 static void big_int_marshal(void *p, JanetMarshalContext *ctx) {
-  bf_t *b = (bf_t *) p;
-  size_t sz;
-  char *digits = big_digits(b, &sz);
-  if (digits == 0)
-    janet_panic("unable to marshall big/int");
   janet_marshal_abstract(ctx, p);
-  janet_marshal_size(ctx, sz+1);
-  janet_marshal_bytes(ctx, (uint8_t *)digits, sz+1);
-  bf_free(&bf_ctx, digits);
-}
-
-static int digits_to_big(bf_t *b, const uint8_t *jstring, size_t sz) {
-  // Safe to assume that jstring (which is a janet_string) is a zero terminated
-  // cstring. (per discussion w/ @bakpakin on gitter.)  But you need to check for
-  // embedded zeros.
-  char *bytes = (char *) jstring;
-  size_t ln = strlen(bytes);
-  if (ln < sz) {
-    // allow for extra zeros at end due to behavior of unmarshall
-    int found_nonzero = 0;
-    for (int i = ln; i < sz; i++) {
-      found_nonzero += (bytes[i] != 0 ? 1 : 0);
-    }
-    if (found_nonzero)
-      return -1; // embedded zeros not at end
-    sz = ln;
-  }
-
-  const char *p = bytes;
-  if (*p == '-') p++;
-  int nd = 0;
-  int has_underscore = 0;
-  int most_recent_digit_is_underscore = 0;
-  const char *end = bytes + sz;
-  for (;p < end; p++) {
-    most_recent_digit_is_underscore = 0;
-    if ((*p < '0' || *p > '9') && *p != '_')
+  big_int_marshal_value((bf_t *) p, ctx);
+}
+
+// Parsing reads the string from its end, so that every
+// bf_radix_limb_digits(radix) digits make one limb, and hands the limbs
+// to the subquadratic radix conversion of libbf.  In decimal strings,
+// runs of plain digits are validated 16 bytes at a time and converted 8
+// digits at a time with multiply-shift steps; underscores, the digits
+// next to them and the other radixes go through the byte by byte loop.
+#define BIG_PARSE_STACK_LIMBS 32
+
+#if !defined(BIG_SSE2) || LIMB_DIGITS != 19
+// SWAR check of 8 digits, used where SSE2 is not
+static int big_is_digits8(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return ((v & UINT64_C(0xF0F0F0F0F0F0F0F0)) |
+          (((v + UINT64_C(0x0606060606060606)) & UINT64_C(0xF0F0F0F0F0F0F0F0)) >> 4))
+         == UINT64_C(0x3333333333333333);
+}
+#endif
+
+static int big_is_digits16(const uint8_t *p) {
+#if defined(BIG_SSE2)
+  // '0'..'9' map to the 10 smallest signed bytes
+  __m128i x = _mm_loadu_si128((const __m128i *) p);
+  x = _mm_add_epi8(x, _mm_set1_epi8((char) (128 - '0')));
+  return _mm_movemask_epi8(_mm_cmplt_epi8(x, _mm_set1_epi8(-128 + 10))) == 0xFFFF;
+#else
+  return big_is_digits8(p) && big_is_digits8(p + 8);
+#endif
+}
+
+// value of the 8 digits at p, which must have been validated
+static uint64_t big_parse8(const uint8_t *p) {
+  uint64_t v;
+#if defined(JANET_LITTLE_ENDIAN)
+  memcpy(&v, p, 8);
+#else
+  v = 0;
+  for (int i = 7; i >= 0; i--)
+    v = (v << 8) | p[i];
+#endif
+  v -= UINT64_C(0x3030303030303030);
+  // pairs of digits, then groups of 4, then the 8 digits
+  v = (v * 10) + (v >> 8);
+  return (((v & UINT64_C(0x000000FF000000FF)) * UINT64_C(0x000F424000000064)) +
+          (((v >> 16) & UINT64_C(0x000000FF000000FF)) * UINT64_C(0x0000271000000001))) >> 32;
+}
+
+static int big_is_limb_digits(const uint8_t *p) {
+#if LIMB_DIGITS == 19
+  return (uint8_t) (p[0] - '0') < 10 && (uint8_t) (p[1] - '0') < 10 &&
+         (uint8_t) (p[2] - '0') < 10 && big_is_digits16(p + 3);
+#else
+  return (uint8_t) (p[0] - '0') < 10 && big_is_digits8(p + 1);
+#endif
+}
+
+static limb_t big_parse_limb(const uint8_t *p) {
+#if LIMB_DIGITS == 19
+  limb_t hi = (p[0] - '0') * 100 + (p[1] - '0') * 10 + (p[2] - '0');
+  return (hi * 100000000 + big_parse8(p + 3)) * 100000000 + big_parse8(p + 11);
+#else
+  return (limb_t) (p[0] - '0') * 100000000 + (limb_t) big_parse8(p + 1);
+#endif
+}
+
+// value of the digit c in radixes up to 36, or 36 if c is not a digit
+static int big_digit_value(uint8_t c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  c |= 0x20; // lower case
+  if (c >= 'a' && c <= 'z')
+    return c - 'a' + 10;
+  return 36;
+}
+
+// For the power of two radixes the digits are just groups of bits, so
+// they are or'ed into the limbs of b in linear time.
+static int digits_to_big_pow2(bf_t *b, const uint8_t *start, const uint8_t *p,
+                              int radix) {
+  int bits = __builtin_ctz(radix);
+  limb_t len = ((limb_t) (p - start) * bits + LIMB_BITS - 1) / LIMB_BITS;
+  if (bf_resize(b, len))
+    return -1;
+  memset(b->tab, 0, len * sizeof(limb_t));
+  limb_t pos = 0;
+  while (p > start) {
+    uint8_t c = *--p;
+    int d = big_digit_value(c);
+    if (d < radix) {
+      limb_t i = pos / LIMB_BITS;
+      int shift = pos % LIMB_BITS;
+      b->tab[i] |= (limb_t) d << shift;
+      if (shift + bits > LIMB_BITS)
+        b->tab[i + 1] |= (limb_t) d >> (LIMB_BITS - shift);
+      pos += bits;
+    } else if (c != '_') {
       return -1;
-    if (*p == '_') {
-      // underscore can not be first digit
-      if (nd == 0)
-        return -1;
-      has_underscore++;
-      most_recent_digit_is_underscore = 1;
-    } else {
-      nd++;
     }
   }
-  if (nd == 0)
-    return -1;
-  if (most_recent_digit_is_underscore)
+  b->sign = 0;
+  b->expn = len * LIMB_BITS;
+  return bf_normalize_and_round(b, BF_PREC_INF, BF_RNDZ);
+}
+
+static int digits_to_big(bf_t *b, const uint8_t *jstring, size_t sz, int radix) {
+  // A janet_string is zero terminated, and unmarshall may leave extra
+  // zeros at the end.  Any other zero byte is an invalid digit.
+  while (sz > 0 && jstring[sz - 1] == 0)
+    sz--;
+  const uint8_t *start = jstring;
+  const uint8_t *p = jstring + sz;
+  int neg = (start < p && *start == '-');
+  start += neg;
+  // no digits, or underscore as first or last digit
+  if (start == p || *start == '_' || p[-1] == '_')
     return -1;
 
-  if (has_underscore) {
-    char *buf = (char *)janet_smalloc(sz);
-    p = bytes;
-    end = bytes + sz;
-    char *t = buf;
-    for ( ; p < end; p++) {
-      if (*p != '_') {
-        *t = *p;
-        t++;
+  int r = -1;
+  if ((radix & (radix - 1)) == 0) {
+    r = digits_to_big_pow2(b, start, p, radix);
+    if (r == 0)
+      b->sign = neg && !bf_is_zero(b);
+    return r;
+  }
+
+  int limb_digits = bf_radix_limb_digits(radix);
+  limb_t stack_tab[BIG_PARSE_STACK_LIMBS];
+  limb_t *tab = stack_tab;
+  size_t max_len = (size_t) (p - start) / limb_digits + 1;
+  if (max_len > BIG_PARSE_STACK_LIMBS)
+    tab = janet_smalloc(max_len * sizeof(limb_t));
+  size_t len = 0;
+  limb_t v = 0, m = 1;
+  int k = 0; // number of digits in v
+  while (p > start) {
+    if (radix == 10 && k == 0 && p - start >= LIMB_DIGITS &&
+        big_is_limb_digits(p - LIMB_DIGITS)) {
+      p -= LIMB_DIGITS;
+      tab[len++] = big_parse_limb(p);
+      continue;
+    }
+    uint8_t c = *--p;
+    int d = big_digit_value(c);
+    if (d < radix) {
+      v += d * m;
+      m *= radix;
+      if (++k == limb_digits) {
+        tab[len++] = v;
+        v = 0;
+        m = 1;
+        k = 0;
       }
+    } else if (c != '_') {
+      goto done;
     }
-    bytes = buf;
   }
+  if (k > 0)
+    tab[len++] = v;
+  r = bf_set_radix_limbs(b, tab, len, radix);
+  if (r == 0)
+    b->sign = neg && !bf_is_zero(b);
+done:
+  if (tab != stack_tab)
+    janet_sfree(tab);
+  return r;
+}
 
-  int r = bf_atof(b, (char *)bytes, 0, 10, BF_PREC_INF, BF_RNDZ | BF_ATOF_NO_NAN_INF);
+static void big_int_unmarshal_binary(bf_t *b, JanetMarshalContext *ctx) {
+  int version = janet_unmarshal_byte(ctx);
+  if (version != BIG_MARSHAL_VERSION)
+    janet_panicf("unsupported big/int marshal version %d", version);
+  int sign = janet_unmarshal_byte(ctx);
+  int64_t expn = janet_unmarshal_int64(ctx);
+  size_t nwords = janet_unmarshal_size(ctx);
+  if (sign > 1)
+    janet_panic("invalid big/int data in unmarshall");
+  if (nwords == 0) {
+    if (expn != (int64_t) BF_EXP_ZERO)
+      janet_panic("invalid big/int data in unmarshall");
+    bf_set_zero(b, sign);
+    return;
+  }
+  // a finite integer has a positive exponent
+  if (expn <= 0 || expn >= (int64_t) BF_EXP_INF)
+    janet_panic("invalid big/int data in unmarshall");
+  // check the data is really there before allocating for it
+  if (nwords > SIZE_MAX / 8)
+    janet_panic("invalid big/int data in unmarshall");
+  janet_unmarshal_ensure(ctx, nwords * 8);
+#if LIMB_BITS == 64
+  if (bf_resize(b, nwords))
+    janet_panic("out of memory in big/int unmarshall");
+#if defined(JANET_LITTLE_ENDIAN)
+  janet_unmarshal_bytes(ctx, (uint8_t *) b->tab, nwords * sizeof(limb_t));
+#else
+  for (size_t i = 0; i < nwords; i++)
+    b->tab[i] = (limb_t) janet_unmarshal_int64(ctx);
+#endif
+#else
+  if (bf_resize(b, nwords * 2))
+    janet_panic("out of memory in big/int unmarshall");
+  for (size_t i = 0; i < nwords; i++) {
+    uint64_t w = (uint64_t) janet_unmarshal_int64(ctx);
+    b->tab[2 * i] = (limb_t) w;
+    b->tab[2 * i + 1] = (limb_t) (w >> 32);
+  }
+#endif
+  b->sign = sign;
+  b->expn = (slimb_t) expn;
+  // well formed data is already normalized, this only guards against bad
+  // input; anything that is not an integer is rejected.
+  bf_normalize_and_round(b, BF_PREC_INF, BF_RNDZ);
+  if (!bf_is_finite(b) || bf_get_exp_min(b) < 0)
+    janet_panic("invalid big/int data in unmarshall");
+}
 
-  if (has_underscore)
-    janet_sfree(bytes);
-  return r;
+// A value written by big_int_marshal_value, always in the binary form.
+static void big_int_unmarshal_value(bf_t *b, JanetMarshalContext *ctx) {
+  if (janet_unmarshal_size(ctx) != BIG_MARSHAL_BINARY)
+    janet_panic("invalid big/int data in unmarshall");
+  big_int_unmarshal_binary(b, ctx);
 }
 
 static void *big_int_unmarshal(JanetMarshalContext *ctx) {
-  bf_t *b = janet_unmarshal_abstract(ctx, sizeof(bf_t));
-  bf_init(&bf_ctx, b);
+  big_int_t *x = janet_unmarshal_abstract(ctx, sizeof(big_int_t));
+  bf_init_inline(big_ctx(), &x->bi);
+  x->hash_ok = 0;
+  bf_t *b = &x->bi.b;
   size_t sz = janet_unmarshal_size(ctx);
+  if (sz == BIG_MARSHAL_BINARY) {
+    big_int_unmarshal_binary(b, ctx);
+    return b;
+  }
+  // legacy decimal string encoding
   uint8_t *bytes = janet_smalloc(sz);
   janet_unmarshal_bytes(ctx, bytes, sz);
   if (bytes[sz-1] != 0)
     janet_panicf("invalid big/int data in unmarshall");
   // in case of bad data in unmarshall, panic -- don't return nil.
-  if (digits_to_big(b, bytes, sz) != 0)
+  if (digits_to_big(b, bytes, sz, 10) != 0)
     janet_panic("unable to unmarshall big/int");
   janet_sfree(bytes);
   return b;
@@ -202,43 +733,113 @@ static const JanetAbstractType big_int_type = {
     JANET_ATEND_HASH
 };
 
-static bf_t *big_coerce_janet_to_int(Janet *argv, int i) {
+// Allocates a new big/int.  Values of up to BF_INLINE_LIMBS limbs keep
+// their mantissa inside the abstract itself, so small big/ints never touch
+// the libbf allocator.
+static bf_t *big_int_alloc(void) {
+  big_int_t *x = janet_abstract(&big_int_type, sizeof(big_int_t));
+  bf_init_inline(big_ctx(), &x->bi);
+  x->hash_ok = 0;
+  return &x->bi.b;
+}
+
+// A bf_t operand that lives on the C stack, used when coercing Janet
+// numbers and int/s64, int/u64 so that (+ x 1) does not allocate a second
+// big/int.  It must only be passed as a const operand and never
+// bf_delete'd.
+typedef bf_inline_t big_tmp_t;
+
+static bf_t *big_tmp_set_u64(big_tmp_t *t, uint64_t v, int sign) {
+  bf_t *b = &t->b;
+  bf_init_inline(big_ctx(), t);
+  if (v == 0)
+    return b;
+  int shift = __builtin_clzll(v);
+  v <<= shift;
+  b->sign = sign;
+  b->expn = 64 - shift;
+#if LIMB_BITS == 64
+  b->len = 1;
+  b->tab[0] = v;
+#else
+  if ((uint32_t) v == 0) {
+    b->len = 1;
+    b->tab[0] = (limb_t) (v >> 32);
+  } else {
+    b->len = 2;
+    b->tab[0] = (limb_t) v;
+    b->tab[1] = (limb_t) (v >> 32);
+  }
+#endif
+  return b;
+}
+
+static bf_t *big_tmp_set_i64(big_tmp_t *t, int64_t v) {
+  if (v < 0)
+    return big_tmp_set_u64(t, (uint64_t) 0 - (uint64_t) v, 1);
+  return big_tmp_set_u64(t, (uint64_t) v, 0);
+}
+
+// The exact value of d, which may be a fraction or infinite.  A double
+// has at most 53 significant bits, so the mantissa is always inline.
+static bf_t *big_tmp_set_float64(big_tmp_t *t, double d) {
+  bf_init_inline(big_ctx(), t);
+  bf_set_float64(&t->b, d);
+  return &t->b;
+}
+
+// Returns argv[i] as a bf_t without allocating: big/ints are returned
+// directly, anything else is converted into the caller's stack temporary.
+static bf_t *big_coerce_janet_to_int(Janet *argv, int i, big_tmp_t *tmp) {
   if (janet_checkabstract(argv[i], &big_int_type))
     return (bf_t *)janet_unwrap_abstract(argv[i]);
 
-  bf_t *b = janet_abstract(&big_int_type, sizeof(bf_t));
-  bf_init(&bf_ctx, b);
-
   switch (janet_type(argv[i])) {
     case JANET_NUMBER:
-      bf_set_si(b, (int64_t) janet_unwrap_number(argv[i]));
-      break;
+      return big_tmp_set_i64(tmp, (int64_t) janet_unwrap_number(argv[i]));
     case JANET_ABSTRACT: {
        void *abst = janet_unwrap_abstract(argv[i]);
        if (janet_abstract_type(abst) == &janet_s64_type) {
-         bf_set_si(b, *(int64_t *)abst);
+         return big_tmp_set_i64(tmp, *(int64_t *)abst);
        } else if (janet_abstract_type(abst) == &janet_u64_type) {
-         bf_set_ui(b, *(uint64_t *)abst);
-       } else {
-         janet_panicf("unable to coerce slot #%d to big int", i);
+         return big_tmp_set_u64(tmp, *(uint64_t *)abst, 0);
        }
        break;
      }
     default:
-       janet_panicf("unable to coerce slot #%d to big int", i);
        break;
   }
-  return b;
+  janet_panicf("unable to coerce slot #%d to big int", i);
+}
+
+static int big_getradix(const Janet *argv, int32_t argc, int32_t n) {
+  int32_t radix = janet_optinteger(argv, argc, n, 10);
+  if (radix < 2 || radix > 36)
+    janet_panicf("radix must be between 2 and 36, got %d", radix);
+  return radix;
+}
+
+// big/modint is defined with the modular arithmetic below.
+static const JanetAbstractType big_modint_type;
+static void big_modint_value(bf_t *r, void *p);
+static Janet big_modint_binop(int32_t argc, Janet *argv, int op, int reverse);
+
+// An operator between a big/int and a big/modint on its right gives a
+// big/modint: Janet only asks the left operand, so the big/int hands the
+// operation over to the reverse operator of the modint.
+static Janet big_int_modint_op(Janet *argv, int op) {
+  Janet swapped[2] = {argv[1], argv[0]};
+  return big_modint_binop(2, swapped, op, 1);
 }
 
 static Janet big_int(int32_t argc, Janet *argv) {
-  janet_fixarity(argc, 1);
+  janet_arity(argc, 1, 2);
+  int radix = big_getradix(argv, argc, 1);
 
   if (janet_checkabstract(argv[0], &big_int_type))
     return argv[0];
 
-  bf_t *b = janet_abstract(&big_int_type, sizeof(bf_t));
-  bf_init(&bf_ctx, b);
+  bf_t *b = big_int_alloc();
 
   switch (janet_type(argv[0])) {
   case JANET_NUMBER:
@@ -254,7 +855,7 @@ static Janet big_int(int32_t argc, Janet *argv) {
   case JANET_STRING: {
       JanetString s = janet_unwrap_string(argv[0]);
       // mirroring janet scan-number, bad input leads to returning nil, not panicing
-      if (digits_to_big(b, s, janet_string_length(s)) != 0)
+      if (digits_to_big(b, s, janet_string_length(s), radix) != 0)
         return janet_wrap_nil();
       break;
     }
@@ -264,6 +865,8 @@ static Janet big_int(int32_t argc, Janet *argv) {
          bf_set_si(b, *(int64_t *)abst);
        } else if (janet_abstract_type(abst) == &janet_u64_type) {
          bf_set_ui(b, *(uint64_t *)abst);
+       } else if (janet_abstract_type(abst) == &big_modint_type) {
+         big_modint_value(b, abst);
        } else {
          janet_panicf("unable to initilize big int from provided type");
        }
@@ -277,38 +880,217 @@ static Janet big_int(int32_t argc, Janet *argv) {
   return janet_wrap_abstract(b);
 }
 
+static Janet big_int_to_string_radix(int32_t argc, Janet *argv) {
+  janet_arity(argc, 1, 2);
+  big_tmp_t tmp;
+  bf_t *b = big_coerce_janet_to_int(argv, 0, &tmp);
+  int radix = big_getradix(argv, argc, 1);
+  bf_t digits;
+  bf_init(big_ctx(), &digits);
+  int32_t len = big_radix_length(b, radix, &digits);
+  if (len < 0) {
+    bf_delete(&digits);
+    janet_panic("unable to convert big/int to string");
+  }
+  uint8_t *str = janet_string_begin(len);
+  big_radix_write((char *) str, b, radix, &digits, len);
+  bf_delete(&digits);
+  return janet_wrap_string(janet_string_end(str));
+}
+
+// Byte strings hold the magnitude, or the two's complement, of an integer
+// in a given number of bytes.  Both directions move a whole limb at a
+// time between the mantissa and the bytes, working directly in the Janet
+// buffer or in the limb array of the new big/int.
+#define BIG_LIMB_BYTES (LIMB_BITS / 8)
+
+// Returns 1 for big endian, the default.
+static int big_getorder(const Janet *argv, int32_t argc, int32_t n) {
+  if (argc <= n || janet_checktype(argv[n], JANET_NIL))
+    return 1;
+  JanetKeyword order = janet_getkeyword(argv, n);
+  if (!janet_cstrcmp(order, "be"))
+    return 1;
+  if (!janet_cstrcmp(order, "le"))
+    return 0;
+  if (!janet_cstrcmp(order, "native")) {
+#if defined(JANET_LITTLE_ENDIAN)
+    return 0;
+#else
+    return 1;
+#endif
+  }
+  janet_panicf("expected byte order :be, :le or :native, got %v", argv[n]);
+}
+
+static limb_t big_bswap_limb(limb_t v) {
+#if LIMB_BITS == 64
+  return __builtin_bswap64(v);
+#else
+  return __builtin_bswap32(v);
+#endif
+}
+
+// Stores the n low bytes of w as bytes k to k + n - 1, counted from the
+// least significant one, of the size byte integer at out.
+static void big_store_bytes(uint8_t *out, int32_t size, int32_t k, limb_t w,
+                            int n, int be) {
+#if defined(JANET_LITTLE_ENDIAN)
+  if (n == BIG_LIMB_BYTES) {
+    if (be) {
+      w = big_bswap_limb(w);
+      memcpy(out + size - k - n, &w, n);
+    } else {
+      memcpy(out + k, &w, n);
+    }
+    return;
+  }
+#endif
+  for (int j = 0; j < n; j++, w >>= 8)
+    out[be ? size - 1 - k - j : k + j] = (uint8_t) w;
+}
+
+// The inverse of big_store_bytes.
+static limb_t big_load_bytes(const uint8_t *in, int32_t size, int32_t k,
+                             int n, int be) {
+  limb_t w = 0;
+#if defined(JANET_LITTLE_ENDIAN)
+  if (n == BIG_LIMB_BYTES) {
+    if (be) {
+      memcpy(&w, in + size - k - n, n);
+      return big_bswap_limb(w);
+    }
+    memcpy(&w, in + k, n);
+    return w;
+  }
+#endif
+  for (int j = n - 1; j >= 0; j--)
+    w = (w << 8) | in[be ? size - 1 - k - j : k + j];
+  return w;
+}
+
+// Bytes needed for b, including the sign bit when is_signed.  Zero needs
+// none.
+static limb_t big_byte_length(const bf_t *b, int is_signed) {
+  if (bf_is_zero(b))
+    return 0;
+  limb_t bits = b->expn;
+  if (is_signed) {
+    // -2^(bits-1) is the only value of that size that needs no extra bit
+    int pow2 = b->tab[b->len - 1] == (limb_t) 1 << (LIMB_BITS - 1);
+    for (limb_t i = 0; pow2 && i < b->len - 1; i++)
+      pow2 = b->tab[i] == 0;
+    if (!(b->sign && pow2))
+      bits++;
+  }
+  return (bits + 7) / 8;
+}
+
+static Janet big_int_to_bytes(int32_t argc, Janet *argv) {
+  janet_arity(argc, 1, 5);
+  big_tmp_t tmp;
+  bf_t *b = big_coerce_janet_to_int(argv, 0, &tmp);
+  int be = big_getorder(argv, argc, 1);
+  int32_t width = janet_optnat(argv, argc, 2, -1);
+  int is_signed = janet_optboolean(argv, argc, 3, 0);
+  if (b->sign && !is_signed && !bf_is_zero(b))
+    janet_panic("big/to-bytes of a negative big/int must be signed");
+  limb_t need = big_byte_length(b, is_signed);
+  if (width < 0) {
+    if (need > INT32_MAX)
+      janet_panic("big/int too large for big/to-bytes");
+    width = need ? (int32_t) need : 1;
+  } else if (need > (limb_t) width) {
+    janet_panicf("big/int does not fit in %d bytes", width);
+  }
+  JanetBuffer *buf = janet_optbuffer(argv, argc, 4, width);
+  janet_buffer_extra(buf, width);
+  uint8_t *out = buf->data + buf->count;
+  if (bf_is_zero(b)) {
+    memset(out, 0, width);
+  } else {
+    // bit 0 of the integer is at offset in the mantissa; a negative value
+    // is written as ~x + 1, with the carry running up the limbs
+    slimb_t offset = (slimb_t) (b->len * LIMB_BITS) - b->expn;
+    limb_t carry = 1;
+    for (int32_t k = 0; k < width; k += BIG_LIMB_BYTES) {
+      limb_t w = big_get_bits(b, offset + (slimb_t) k * 8);
+      if (b->sign) {
+        limb_t nw = ~w + carry;
+        carry &= (w == 0);
+        w = nw;
+      }
+      int n = width - k < BIG_LIMB_BYTES ? width - k : BIG_LIMB_BYTES;
+      big_store_bytes(out, width, k, w, n, be);
+    }
+  }
+  buf->count += width;
+  return janet_wrap_buffer(buf);
+}
+
+static Janet big_int_from_bytes(int32_t argc, Janet *argv) {
+  janet_arity(argc, 1, 3);
+  JanetByteView bytes = janet_getbytes(argv, 0);
+  int be = big_getorder(argv, argc, 1);
+  int is_signed = janet_optboolean(argv, argc, 2, 0);
+  bf_t *b = big_int_alloc();
+  int32_t size = bytes.len;
+  if (size == 0)
+    return janet_wrap_abstract(b);
+  limb_t len = ((limb_t) size + BIG_LIMB_BYTES - 1) / BIG_LIMB_BYTES;
+  if (bf_resize(b, len))
+    janet_panic("out of memory in big/from-bytes");
+  int top = len * BIG_LIMB_BYTES - size; // missing bytes of the top limb
+  for (limb_t i = 0; i < len; i++) {
+    int32_t k = (int32_t) (i * BIG_LIMB_BYTES);
+    int n = i == len - 1 ? BIG_LIMB_BYTES - top : BIG_LIMB_BYTES;
+    b->tab[i] = big_load_bytes(bytes.bytes, size, k, n, be);
+  }
+  int neg = is_signed && (bytes.bytes[be ? 0 : size - 1] & 0x80);
+  if (neg) {
+    // sign extend the top limb, then take ~x + 1 as the magnitude
+    if (top)
+      b->tab[len - 1] |= (limb_t) -1 << (LIMB_BITS - 8 * top);
+    limb_t carry = 1;
+    for (limb_t i = 0; i < len; i++) {
+      limb_t w = b->tab[i];
+      b->tab[i] = ~w + carry;
+      carry &= (w == 0);
+    }
+  }
+  b->sign = neg;
+  b->expn = len * LIMB_BITS;
+  bf_normalize_and_round(b, BF_PREC_INF, BF_RNDZ);
+  return janet_wrap_abstract(b);
+}
+
+// Compares with Janet numbers exactly, fractions included, and with
+// int/s64, int/u64 through stack temporaries, so no comparison allocates.
 static Janet big_int_compare_meth(int32_t argc, Janet *argv) {
   janet_fixarity(argc, 2);
 
   if (!janet_checkabstract(argv[0], &big_int_type))
     janet_panic("compare method requires big/int as first argument");
-  bf_t *a = (bf_t *)janet_getabstract(argv, 0, &big_int_type);               \
-
-  int r;
-  bf_t b; // not wrapped in a Janet: must bf_delete if bf_init called on it
+  bf_t *a = (bf_t *)janet_unwrap_abstract(argv[0]);
+  big_tmp_t tmp;
+  bf_t *b;
 
   switch (janet_type(argv[1])) {
-  case JANET_NUMBER:
-    bf_init(&bf_ctx, &b);
-    bf_set_si(&b, (int64_t) janet_unwrap_number(argv[1]));
-    r = bf_cmp(a, &b);
-    bf_delete(&b);
-    break;
+  case JANET_NUMBER: {
+      double d = janet_unwrap_number(argv[1]);
+      if (isnan(d))
+        return janet_wrap_nil();
+      b = big_tmp_set_float64(&tmp, d);
+      break;
+    }
   case JANET_ABSTRACT: {
        void *abst = janet_unwrap_abstract(argv[1]);
        if (janet_abstract_type(abst) == &janet_s64_type) {
-         bf_init(&bf_ctx, &b);
-         bf_set_si(&b, *(int64_t *)abst);
-         r = bf_cmp(a, &b);
-         bf_delete(&b);
+         b = big_tmp_set_i64(&tmp, *(int64_t *)abst);
        } else if (janet_abstract_type(abst) == &janet_u64_type) {
-         bf_init(&bf_ctx, &b);
-         bf_set_ui(&b, *(uint64_t *)abst);
-         r = bf_cmp(a, &b);
-         bf_delete(&b);
+         b = big_tmp_set_u64(&tmp, *(uint64_t *)abst, 0);
        } else if (janet_abstract_type(abst) == &big_int_type) {
-         bf_t *c = (bf_t *)janet_getabstract(argv, 1, &big_int_type);               \
-         r = bf_cmp(a, c);
+         b = (bf_t *)abst;
        } else {
          return janet_wrap_nil();
        }
@@ -318,16 +1100,18 @@ static Janet big_int_compare_meth(int32_t argc, Janet *argv) {
     return janet_wrap_nil();
     break;
   }
-  return janet_wrap_number(r);
+  return janet_wrap_number(bf_cmp(a, b));
 }
 
-#define BIGINT_OPMETHOD(NAME, OP, L, R)                                        \
+#define BIGINT_OPMETHOD(NAME, OP, MOP, L, R)                                   \
   static Janet big_int_##NAME(int32_t argc, Janet *argv) {                     \
     janet_fixarity(argc, 2);                                                   \
-    bf_t *r = janet_abstract(&big_int_type, sizeof(bf_t));                     \
-    bf_init(&bf_ctx, r);                                                       \
+    if (janet_checkabstract(argv[1], &big_modint_type))                        \
+      return big_int_modint_op(argv, MOP);                                     \
+    bf_t *r = big_int_alloc();                                                 \
     bf_t *L = (bf_t *)janet_getabstract(argv, 0, &big_int_type);               \
-    bf_t *R = big_coerce_janet_to_int(argv, 1);                                \
+    big_tmp_t tmp;                                                             \
+    bf_t *R = big_coerce_janet_to_int(argv, 1, &tmp);                          \
     bf_##OP(r, L, R, BF_PREC_INF, BF_RNDZ);                                    \
     return janet_wrap_abstract(r);                                             \
   }
@@ -335,10 +1119,10 @@ static Janet big_int_compare_meth(int32_t argc, Janet *argv) {
 #define BIGINT_ROPMETHOD(NAME, OP, L, R)                                        \
   static Janet big_int_##NAME(int32_t argc, Janet *argv) {                     \
     janet_fixarity(argc, 2);                                                   \
-    bf_t *r = janet_abstract(&big_int_type, sizeof(bf_t));                     \
-    bf_init(&bf_ctx, r);                                                       \
+    bf_t *r = big_int_alloc();                                                 \
     bf_t *L = (bf_t *)janet_getabstract(argv, 0, &big_int_type);               \
-    bf_t *R = big_coerce_janet_to_int(argv, 1);                                \
+    big_tmp_t tmp;                                                             \
+    bf_t *R = big_coerce_janet_to_int(argv, 1, &tmp);                          \
     bf_##OP(r, R, L, BF_PREC_INF, BF_RNDZ);                                    \
     return janet_wrap_abstract(r);                                             \
   }
@@ -346,10 +1130,10 @@ static Janet big_int_compare_meth(int32_t argc, Janet *argv) {
 #define BIGINT_LOGICMETHOD(NAME, OP, L, R)                                     \
   static Janet big_int_##NAME(int32_t argc, Janet *argv) {                     \
     janet_fixarity(argc, 2);                                                   \
-    bf_t *r = janet_abstract(&big_int_type, sizeof(bf_t));                     \
-    bf_init(&bf_ctx, r);                                                       \
+    bf_t *r = big_int_alloc();                                                 \
     bf_t *L = (bf_t *)janet_getabstract(argv, 0, &big_int_type);               \
-    bf_t *R = big_coerce_janet_to_int(argv, 1);                                \
+    big_tmp_t tmp;                                                             \
+    bf_t *R = big_coerce_janet_to_int(argv, 1, &tmp);                          \
     bf_##OP(r, L, R);                                                          \
     return janet_wrap_abstract(r);                                             \
   }
@@ -357,77 +1141,75 @@ static Janet big_int_compare_meth(int32_t argc, Janet *argv) {
 #define BIGINT_RLOGICMETHOD(NAME, OP, L, R)                                     \
   static Janet big_int_##NAME(int32_t argc, Janet *argv) {                     \
     janet_fixarity(argc, 2);                                                   \
-    bf_t *r = janet_abstract(&big_int_type, sizeof(bf_t));                     \
-    bf_init(&bf_ctx, r);                                                       \
+    bf_t *r = big_int_alloc();                                                 \
     bf_t *L = (bf_t *)janet_getabstract(argv, 0, &big_int_type);               \
-    bf_t *R = big_coerce_janet_to_int(argv, 1);                                \
+    big_tmp_t tmp;                                                             \
+    bf_t *R = big_coerce_janet_to_int(argv, 1, &tmp);                          \
     bf_##OP(r, R, L);                                                          \
     return janet_wrap_abstract(r);                                             \
   }
 
+// Truncated division of argv[0] by argv[1], or of argv[1] by argv[0]
+// with reverse.  Only the big/ints for the non NULL qp and rp are made,
+// so / never computes a remainder and % never computes a quotient.  With
+// mod a nonzero remainder takes the sign of the divisor.
 static void big_int_divop(int32_t argc, Janet *argv, int reverse, int mod, bf_t **qp, bf_t **rp) {
   janet_fixarity(argc, 2);
-  bf_t *r = janet_abstract(&big_int_type, sizeof(bf_t));
-  bf_init(&bf_ctx, r);
-  bf_t *q = janet_abstract(&big_int_type, sizeof(bf_t));
-  bf_init(&bf_ctx, q);
-  //bf_t *L = (bf_t *)janet_getabstract(argv, 0, &big_int_type);
-  bf_t *L = big_coerce_janet_to_int(argv, 0);
-  bf_t *R = big_coerce_janet_to_int(argv, 1);
-  int e;
-  if (reverse) {
-    e = bf_divrem(q, r, R, L, BF_PREC_INF, BF_RNDZ, BF_RNDZ);
-  } else {
-    e = bf_divrem(q, r, L, R, BF_PREC_INF, BF_RNDZ, BF_RNDZ);
-  }
-  if (e == BF_ST_INVALID_OP || e == BF_ST_DIVIDE_ZERO) {
+  big_tmp_t ltmp, rtmp;
+  bf_t *L = big_coerce_janet_to_int(argv, 0, &ltmp);
+  bf_t *R = big_coerce_janet_to_int(argv, 1, &rtmp);
+  bf_t *n = reverse ? R : L;
+  bf_t *d = reverse ? L : R;
+  bf_t *q = qp ? big_int_alloc() : NULL;
+  bf_t *r = rp ? big_int_alloc() : NULL;
+  int e = bf_tdivrem_int(q, r, n, d);
+  if (e == BF_ST_DIVIDE_ZERO)
     janet_panicf("Invalid argument to divide");
-  }
-  if (mod && L->sign != R->sign) {
-    if (reverse) {
-      bf_add(r, r, L, BF_PREC_INF, BF_RNDZ);                                    \
-    } else {
-      bf_add(r, r, R, BF_PREC_INF, BF_RNDZ);                                    \
-    }
-  }
-  *qp = q;
-  *rp = r;
-  return;
+  if (e & BF_ST_MEM_ERROR)
+    janet_panic("out of memory in big/int division");
+  if (mod && r != NULL && !bf_is_zero(r) && r->sign != d->sign)
+    bf_add(r, r, d, BF_PREC_INF, BF_RNDZ);
+  if (qp)
+    *qp = q;
+  if (rp)
+    *rp = r;
 }
 
 static Janet big_int_div(int32_t argc, Janet *argv) {
-  bf_t *q, *r;
-  big_int_divop(argc, argv, 0, 0, &q, &r);
+  if (argc == 2 && janet_checkabstract(argv[1], &big_modint_type))
+    return big_int_modint_op(argv, '/');
+  bf_t *q;
+  big_int_divop(argc, argv, 0, 0, &q, NULL);
   return janet_wrap_abstract(q);
 }
 
 static Janet big_int_rem(int32_t argc, Janet *argv) {
-  bf_t *q, *r;
-  big_int_divop(argc, argv, 0, 0, &q, &r);
+  bf_t *r;
+  big_int_divop(argc, argv, 0, 0, NULL, &r);
   return janet_wrap_abstract(r);
 }
 
 static Janet big_int_mod(int32_t argc, Janet *argv) {
-  bf_t *q, *r;
-  big_int_divop(argc, argv, 0, 1, &q, &r);
+  bf_t *r;
+  big_int_divop(argc, argv, 0, 1, NULL, &r);
   return janet_wrap_abstract(r);
 }
 
 static Janet big_int_rdiv(int32_t argc, Janet *argv) {
-  bf_t *q, *r;
-  big_int_divop(argc, argv, 1, 0, &q, &r);
+  bf_t *q;
+  big_int_divop(argc, argv, 1, 0, &q, NULL);
   return janet_wrap_abstract(q);
 }
 
 static Janet big_int_rrem(int32_t argc, Janet *argv) {
-  bf_t *q, *r;
-  big_int_divop(argc, argv, 1, 0, &q, &r);
+  bf_t *r;
+  big_int_divop(argc, argv, 1, 0, NULL, &r);
   return janet_wrap_abstract(r);
 }
 
 static Janet big_int_rmod(int32_t argc, Janet *argv) {
-  bf_t *q, *r;
-  big_int_divop(argc, argv, 1, 1, &q, &r);
+  bf_t *r;
+  big_int_divop(argc, argv, 1, 1, NULL, &r);
   return janet_wrap_abstract(r);
 }
 
@@ -453,17 +1235,543 @@ static Janet big_int_divmod(int32_t argc, Janet *argv) {
   return janet_wrap_tuple(janet_tuple_n(tup, 2));
 }
 
-BIGINT_OPMETHOD(add, add, a, b)
-BIGINT_OPMETHOD(sub, sub, a, b)
-BIGINT_OPMETHOD(mul, mul, a, b)
-//BIGINT_OPMETHOD(div, div, a, b)
+// A big/divisor is a divisor prepared once for many divisions: its limbs
+// are normalized and, depending on its size, the Newton reciprocal or the
+// one limb inverse is computed up front, so that each division by it is
+// left with the multiplications.  The value itself is kept for the sign
+// adjustment of big/divmod-by.
+typedef struct {
+  BFDivisor d;
+  bf_t value;
+} big_divisor_t;
+
+static int big_divisor_gc(void *p, size_t len) {
+  (void) len;
+  big_divisor_t *dv = (big_divisor_t *) p;
+  bf_divisor_end(&dv->d);
+  bf_delete(&dv->value);
+  return 0;
+}
+
+static const JanetAbstractType big_divisor_type = {
+  "big/divisor",
+  big_divisor_gc,
+  JANET_ATEND_GC
+};
+
+static Janet big_divisor(int32_t argc, Janet *argv) {
+  janet_fixarity(argc, 1);
+  big_tmp_t tmp;
+  bf_t *b = big_coerce_janet_to_int(argv, 0, &tmp);
+  big_divisor_t *dv = janet_abstract(&big_divisor_type, sizeof(big_divisor_t));
+  bf_init(big_ctx(), &dv->value);
+  int e = bf_divisor_init(big_ctx(), &dv->d, b);
+  if (e == BF_ST_DIVIDE_ZERO)
+    janet_panic("big/divisor of zero");
+  if (e != 0 || bf_set(&dv->value, b))
+    janet_panic("out of memory in big/divisor");
+  return janet_wrap_abstract(dv);
+}
+
+// big_int_divop by a big/divisor.
+static void big_int_divop_by(int32_t argc, Janet *argv, int mod, bf_t **qp, bf_t **rp) {
+  janet_fixarity(argc, 2);
+  big_tmp_t tmp;
+  bf_t *n = big_coerce_janet_to_int(argv, 0, &tmp);
+  big_divisor_t *dv = (big_divisor_t *)janet_getabstract(argv, 1, &big_divisor_type);
+  bf_t *q = qp ? big_int_alloc() : NULL;
+  bf_t *r = rp ? big_int_alloc() : NULL;
+  if (bf_divisor_divrem(q, r, n, &dv->d) & BF_ST_MEM_ERROR)
+    janet_panic("out of memory in big/int division");
+  if (mod && r != NULL && !bf_is_zero(r) && r->sign != dv->value.sign)
+    bf_add(r, r, &dv->value, BF_PREC_INF, BF_RNDZ);
+  if (qp)
+    *qp = q;
+  if (rp)
+    *rp = r;
+}
+
+static Janet big_int_div_by(int32_t argc, Janet *argv) {
+  bf_t *q;
+  big_int_divop_by(argc, argv, 0, &q, NULL);
+  return janet_wrap_abstract(q);
+}
+
+static Janet big_int_rem_by(int32_t argc, Janet *argv) {
+  bf_t *r;
+  big_int_divop_by(argc, argv, 0, NULL, &r);
+  return janet_wrap_abstract(r);
+}
+
+static Janet big_int_divmod_by(int32_t argc, Janet *argv) {
+  bf_t *q, *r;
+  big_int_divop_by(argc, argv, 1, &q, &r);
+
+  Janet tup[2];
+  tup[0] = janet_wrap_abstract(q);
+  tup[1] = janet_wrap_abstract(r);
+  return janet_wrap_tuple(janet_tuple_n(tup, 2));
+}
+
+static Janet big_int_gcd(int32_t argc, Janet *argv) {
+  janet_fixarity(argc, 2);
+  big_tmp_t xtmp, ytmp;
+  bf_t *x = big_coerce_janet_to_int(argv, 0, &xtmp);
+  bf_t *y = big_coerce_janet_to_int(argv, 1, &ytmp);
+  bf_t *r = big_int_alloc();
+  if (bf_gcd(r, x, y))
+    janet_panic("out of memory in big/gcd");
+  return janet_wrap_abstract(r);
+}
+
+static Janet big_int_lcm(int32_t argc, Janet *argv) {
+  janet_fixarity(argc, 2);
+  big_tmp_t xtmp, ytmp;
+  bf_t *x = big_coerce_janet_to_int(argv, 0, &xtmp);
+  bf_t *y = big_coerce_janet_to_int(argv, 1, &ytmp);
+  bf_t *r = big_int_alloc();
+  if (bf_is_zero(x) || bf_is_zero(y))
+    return janet_wrap_abstract(r);
+  // |x / gcd * y|, dividing the smaller operand
+  if (bf_cmpu(x, y) > 0) {
+    bf_t *t = x;
+    x = y;
+    y = t;
+  }
+  bf_t g;
+  bf_init(big_ctx(), &g);
+  int e = bf_gcd(&g, x, y);
+  e |= bf_tdivrem_int(r, NULL, x, &g);
+  e |= bf_mul(r, r, y, BF_PREC_INF, BF_RNDZ);
+  bf_delete(&g);
+  if (e & BF_ST_MEM_ERROR)
+    janet_panic("out of memory in big/lcm");
+  r->sign = 0;
+  return janet_wrap_abstract(r);
+}
+
+static Janet big_int_gcdext(int32_t argc, Janet *argv) {
+  janet_fixarity(argc, 2);
+  big_tmp_t xtmp, ytmp;
+  bf_t *x = big_coerce_janet_to_int(argv, 0, &xtmp);
+  bf_t *y = big_coerce_janet_to_int(argv, 1, &ytmp);
+  bf_t *g = big_int_alloc();
+  bf_t *u = big_int_alloc();
+  bf_t *v = big_int_alloc();
+  if (bf_gcdext(g, u, v, x, y))
+    janet_panic("out of memory in big/gcdext");
+
+  Janet tup[3];
+  tup[0] = janet_wrap_abstract(g);
+  tup[1] = janet_wrap_abstract(u);
+  tup[2] = janet_wrap_abstract(v);
+  return janet_wrap_tuple(janet_tuple_n(tup, 3));
+}
+
+// A big/modulus is a positive modulus prepared for modular arithmetic:
+// Montgomery reduction when it is odd, division by its cached reciprocal
+// (Barrett reduction) when it is even.
+typedef struct {
+  BFModulus m;
+} big_modulus_t;
+
+static int big_modulus_gc(void *p, size_t len) {
+  (void) len;
+  big_modulus_t *mod = (big_modulus_t *) p;
+  bf_modulus_end(&mod->m);
+  return 0;
+}
+
+// A big/modulus is marshalled as its value and prepared again when it is
+// unmarshalled.
+static void big_modulus_marshal(void *p, JanetMarshalContext *ctx) {
+  BFModulus *m = &((big_modulus_t *) p)->m;
+  janet_marshal_abstract(ctx, p);
+  // the normalized limbs of the divisor, shifted right
+  bf_t b;
+  b.ctx = m->ctx;
+  b.sign = 0;
+  b.has_inline = 0;
+  b.expn = (slimb_t) (m->div.len * LIMB_BITS) - m->div.shift;
+  b.len = m->div.len;
+  b.tab = m->div.tab;
+  big_int_marshal_value(&b, ctx);
+}
+
+static void *big_modulus_unmarshal(JanetMarshalContext *ctx) {
+  big_modulus_t *mod = janet_unmarshal_abstract(ctx, sizeof(big_modulus_t));
+  // safe to finalize until it is prepared
+  memset(mod, 0, sizeof(big_modulus_t));
+  bf_t *b = big_int_alloc();
+  big_int_unmarshal_value(b, ctx);
+  if (b->sign || bf_is_zero(b))
+    janet_panic("invalid big/modulus data in unmarshall");
+  if (bf_modulus_init(big_ctx(), &mod->m, b))
+    janet_panic("out of memory in big/modulus unmarshall");
+  return mod;
+}
+
+static const JanetAbstractType big_modulus_type = {
+  "big/modulus",
+  big_modulus_gc,
+  NULL,
+  NULL,
+  NULL,
+  big_modulus_marshal,
+  big_modulus_unmarshal,
+  JANET_ATEND_UNMARSHAL
+};
+
+static bf_t *big_getmodulus(Janet *argv, int32_t n, big_tmp_t *tmp) {
+  bf_t *b = big_coerce_janet_to_int(argv, n, tmp);
+  if (b->sign || bf_is_zero(b))
+    janet_panic("modulus must be positive");
+  return b;
+}
+
+static Janet big_modulus(int32_t argc, Janet *argv) {
+  janet_fixarity(argc, 1);
+  big_tmp_t tmp;
+  bf_t *b = big_getmodulus(argv, 0, &tmp);
+  big_modulus_t *mod = janet_abstract(&big_modulus_type, sizeof(big_modulus_t));
+  if (bf_modulus_init(big_ctx(), &mod->m, b))
+    janet_panic("out of memory in big/modulus");
+  return janet_wrap_abstract(mod);
+}
+
+static Janet big_int_powmod(int32_t argc, Janet *argv) {
+  janet_fixarity(argc, 3);
+  big_tmp_t xtmp, etmp, mtmp;
+  bf_t *x = big_coerce_janet_to_int(argv, 0, &xtmp);
+  bf_t *e = big_coerce_janet_to_int(argv, 1, &etmp);
+  if (e->sign)
+    janet_panicf("big/powmod called with negative exponent");
+  bf_t *r = big_int_alloc();
+  int err;
+  if (janet_checkabstract(argv[2], &big_modulus_type)) {
+    big_modulus_t *mod = (big_modulus_t *)janet_unwrap_abstract(argv[2]);
+    err = bf_powmod(r, x, e, &mod->m);
+  } else {
+    // a one-off modulus on the stack
+    BFModulus m;
+    bf_t *b = big_getmodulus(argv, 2, &mtmp);
+    err = bf_modulus_init(big_ctx(), &m, b);
+    if (!err)
+      err = bf_powmod(r, x, e, &m);
+    bf_modulus_end(&m);
+  }
+  if (err)
+    janet_panic("out of memory in big/powmod");
+  return janet_wrap_abstract(r);
+}
+
+static Janet big_int_invmod(int32_t argc, Janet *argv) {
+  janet_fixarity(argc, 2);
+  big_tmp_t xtmp, mtmp;
+  bf_t *x = big_coerce_janet_to_int(argv, 0, &xtmp);
+  bf_t *r = big_int_alloc();
+  int err;
+  if (janet_checkabstract(argv[1], &big_modulus_type)) {
+    // through a residue, in the representation of the modulus
+    BFModulus *m = &((big_modulus_t *)janet_unwrap_abstract(argv[1]))->m;
+    limb_t *tab = janet_smalloc(m->len * sizeof(limb_t));
+    err = bf_modulus_set(m, tab, x);
+    if (!err)
+      err = bf_modulus_inv(m, tab, tab);
+    if (!err)
+      err = bf_modulus_get(m, r, tab);
+    janet_sfree(tab);
+  } else {
+    err = bf_invmod(r, x, big_getmodulus(argv, 1, &mtmp));
+  }
+  if (err == BF_ST_INVALID_OP)
+    janet_panic("big/invmod of a value not invertible modulo the modulus");
+  if (err & BF_ST_MEM_ERROR)
+    janet_panic("out of memory in big/invmod");
+  return janet_wrap_abstract(r);
+}
+
+// All the values share one inversion: the residues are multiplied
+// together, the product inverted and the inverse of each value recovered
+// from the partial products.
+static Janet big_int_invmod_many(int32_t argc, Janet *argv) {
+  janet_fixarity(argc, 2);
+  JanetView xs = janet_getindexed(argv, 0);
+  Janet modulus = argv[1];
+  if (!janet_checkabstract(modulus, &big_modulus_type))
+    modulus = big_modulus(1, argv + 1);
+  BFModulus *m = &((big_modulus_t *)janet_unwrap_abstract(modulus))->m;
+  limb_t len = m->len;
+  limb_t *a = janet_smalloc(2 * (size_t) xs.len * len * sizeof(limb_t) + 1);
+  limb_t *inv = a + (size_t) xs.len * len;
+  for (int32_t i = 0; i < xs.len; i++) {
+    big_tmp_t tmp;
+    bf_t *x = big_coerce_janet_to_int((Janet *) xs.items, i, &tmp);
+    if (bf_modulus_set(m, a + i * len, x))
+      janet_panic("out of memory in big/invmod-many");
+  }
+  int err = bf_modulus_inv_many(m, inv, a, xs.len);
+  if (err == BF_ST_INVALID_OP) {
+    // find the culprit
+    for (int32_t i = 0; i < xs.len; i++) {
+      if (bf_modulus_inv(m, inv, a + i * len) == BF_ST_INVALID_OP)
+        janet_panicf("big/invmod-many of a value not invertible modulo the modulus at index %d", i);
+    }
+    janet_panic("big/invmod-many of values not invertible modulo the modulus");
+  }
+  if (err & BF_ST_MEM_ERROR)
+    janet_panic("out of memory in big/invmod-many");
+  JanetArray *res = janet_array(xs.len);
+  for (int32_t i = 0; i < xs.len; i++) {
+    bf_t *r = big_int_alloc();
+    if (bf_modulus_get(m, r, inv + i * len))
+      janet_panic("out of memory in big/invmod-many");
+    janet_array_push(res, janet_wrap_abstract(r));
+  }
+  janet_sfree(a);
+  return janet_wrap_array(res);
+}
+
+// A big/modint is a residue modulo a big/modulus, which it keeps alive.
+// Its limbs follow in the same allocation, in Montgomery form for an odd
+// modulus, and every operation reduces right away, so chains of modular
+// operations never leave the reduced domain.
+typedef struct {
+  Janet modulus;
+  limb_t tab[];
+} big_modint_t;
+
+static BFModulus *big_modint_modulus(big_modint_t *x) {
+  return &((big_modulus_t *) janet_unwrap_abstract(x->modulus))->m;
+}
+
+static int big_modulus_eq(const BFModulus *a, const BFModulus *b) {
+  return a == b || (a->len == b->len && a->div.shift == b->div.shift &&
+                    !memcmp(a->div.tab, b->div.tab, a->len * sizeof(limb_t)));
+}
+
+static big_modint_t *big_modint_alloc(Janet modulus) {
+  BFModulus *m = &((big_modulus_t *) janet_unwrap_abstract(modulus))->m;
+  big_modint_t *x = janet_abstract(&big_modint_type,
+                                   sizeof(big_modint_t) + m->len * sizeof(limb_t));
+  x->modulus = modulus;
+  return x;
+}
+
+static void big_modint_value(bf_t *r, void *p) {
+  big_modint_t *x = (big_modint_t *) p;
+  if (bf_modulus_get(big_modint_modulus(x), r, x->tab))
+    janet_panic("out of memory in big/modint");
+}
+
+static int big_modint_gcmark(void *p, size_t len) {
+  (void) len;
+  janet_mark(((big_modint_t *) p)->modulus);
+  return 0;
+}
+
+static void big_modint_to_string(void *p, JanetBuffer *buf) {
+  bf_t v;
+  bf_init(big_ctx(), &v);
+  big_modint_value(&v, p);
+  big_int_to_string(&v, buf);
+  bf_delete(&v);
+}
+
+// Ordered by modulus, then by value.
+static int big_modint_compare(void *p1, void *p2) {
+  big_modint_t *x = (big_modint_t *) p1;
+  big_modint_t *y = (big_modint_t *) p2;
+  BFModulus *mx = big_modint_modulus(x), *my = big_modint_modulus(y);
+  if (!big_modulus_eq(mx, my)) {
+    // compare the bit lengths, then the normalized limbs
+    int64_t bx = (int64_t) mx->len * LIMB_BITS - mx->div.shift;
+    int64_t by = (int64_t) my->len * LIMB_BITS - my->div.shift;
+    if (bx != by)
+      return bx < by ? -1 : 1;
+    for (limb_t i = mx->len; i-- > 0;) {
+      if (mx->div.tab[i] != my->div.tab[i])
+        return mx->div.tab[i] < my->div.tab[i] ? -1 : 1;
+    }
+  }
+  bf_t vx, vy;
+  bf_init(big_ctx(), &vx);
+  bf_init(big_ctx(), &vy);
+  big_modint_value(&vx, x);
+  big_modint_value(&vy, y);
+  int c = bf_cmp(&vx, &vy);
+  bf_delete(&vx);
+  bf_delete(&vy);
+  return c;
+}
+
+// Equal modints have the same modulus, so the same residue limbs.
+static int32_t big_modint_hash(void *p, size_t size) {
+  (void) size;
+  big_modint_t *x = (big_modint_t *) p;
+  limb_t n = big_modint_modulus(x)->len;
+  uint64_t h = big_hash_mix(0, (uint64_t) n);
+  for (limb_t i = 0; i < n; i++)
+    h = big_hash_mix(h, x->tab[i]);
+  return (int32_t) (h ^ (h >> 32));
+}
+
+// The modulus goes first, since the size of the modint depends on it,
+// and is written only once for all the modints that share it.  The
+// residue is written as its plain value: the Montgomery form depends on
+// the size of the limbs.
+static void big_modint_marshal(void *p, JanetMarshalContext *ctx) {
+  big_modint_t *x = (big_modint_t *) p;
+  janet_marshal_janet(ctx, x->modulus);
+  janet_marshal_abstract(ctx, p);
+  bf_t v;
+  bf_init(big_ctx(), &v);
+  big_modint_value(&v, x);
+  big_int_marshal_value(&v, ctx);
+  bf_delete(&v);
+}
+
+static void *big_modint_unmarshal(JanetMarshalContext *ctx) {
+  Janet modulus = janet_unmarshal_janet(ctx);
+  if (!janet_checkabstract(modulus, &big_modulus_type))
+    janet_panic("invalid big/modint data in unmarshall");
+  BFModulus *m = &((big_modulus_t *) janet_unwrap_abstract(modulus))->m;
+  big_modint_t *x = janet_unmarshal_abstract(ctx,
+                                             sizeof(big_modint_t) + m->len * sizeof(limb_t));
+  x->modulus = modulus;
+  bf_t *v = big_int_alloc();
+  big_int_unmarshal_value(v, ctx);
+  if (bf_modulus_set(m, x->tab, v))
+    janet_panic("out of memory in big/modint unmarshall");
+  return x;
+}
+
+static int big_modint_get(void *p, Janet key, Janet *out);
+
+static const JanetAbstractType big_modint_type = {
+  "big/modint",
+  NULL,
+  big_modint_gcmark,
+  big_modint_get,
+  NULL,
+  big_modint_marshal,
+  big_modint_unmarshal,
+  big_modint_to_string,
+  big_modint_compare,
+  big_modint_hash,
+  JANET_ATEND_HASH
+};
+
+static Janet big_modint(int32_t argc, Janet *argv) {
+  janet_fixarity(argc, 2);
+  Janet modulus = argv[1];
+  if (!janet_checkabstract(modulus, &big_modulus_type))
+    modulus = big_modulus(1, argv + 1);
+  big_modint_t *x = big_modint_alloc(modulus);
+  if (janet_checkabstract(argv[0], &big_modint_type)) {
+    // the value of a modint in another modulus
+    bf_t v;
+    bf_init(big_ctx(), &v);
+    big_modint_value(&v, janet_unwrap_abstract(argv[0]));
+    int err = bf_modulus_set(big_modint_modulus(x), x->tab, &v);
+    bf_delete(&v);
+    if (err)
+      janet_panic("out of memory in big/modint");
+  } else {
+    big_tmp_t tmp;
+    bf_t *v = big_coerce_janet_to_int(argv, 0, &tmp);
+    if (bf_modulus_set(big_modint_modulus(x), x->tab, v))
+      janet_panic("out of memory in big/modint");
+  }
+  return janet_wrap_abstract(x);
+}
+
+// r = x / y through the inverse of y.
+static void big_modint_divide(BFModulus *m, limb_t *r, const limb_t *x, const limb_t *y) {
+  limb_t *inv = janet_smalloc(m->len * sizeof(limb_t));
+  int err = bf_modulus_inv(m, inv, y);
+  if (!err)
+    err = bf_modulus_mul(m, r, x, inv);
+  janet_sfree(inv);
+  if (err == BF_ST_INVALID_OP)
+    janet_panic("big/modint division by a value not invertible modulo the modulus");
+  if (err)
+    janet_panic("out of memory in big/modint");
+}
+
+// The operator op between the modint argv[0] and argv[1], a modint of the
+// same modulus or an integer, with the operands swapped when reverse.
+static Janet big_modint_binop(int32_t argc, Janet *argv, int op, int reverse) {
+  janet_fixarity(argc, 2);
+  big_modint_t *a = (big_modint_t *)janet_getabstract(argv, 0, &big_modint_type);
+  BFModulus *m = big_modint_modulus(a);
+  big_modint_t *r = big_modint_alloc(a->modulus);
+  const limb_t *b = r->tab;
+  if (janet_checkabstract(argv[1], &big_modint_type)) {
+    big_modint_t *y = (big_modint_t *) janet_unwrap_abstract(argv[1]);
+    if (!big_modulus_eq(m, big_modint_modulus(y)))
+      janet_panic("big/modint operands have different moduli");
+    b = y->tab;
+  } else {
+    big_tmp_t tmp;
+    if (bf_modulus_set(m, r->tab, big_coerce_janet_to_int(argv, 1, &tmp)))
+      janet_panic("out of memory in big/modint");
+  }
+  const limb_t *x = reverse ? b : a->tab;
+  const limb_t *y = reverse ? a->tab : b;
+  switch (op) {
+    case '+':
+      bf_modulus_add(m, r->tab, x, y);
+      break;
+    case '-':
+      bf_modulus_sub(m, r->tab, x, y);
+      break;
+    case '*':
+      if (bf_modulus_mul(m, r->tab, x, y))
+        janet_panic("out of memory in big/modint");
+      break;
+    default:
+      big_modint_divide(m, r->tab, x, y);
+      break;
+  }
+  return janet_wrap_abstract(r);
+}
+
+#define BIG_MODINT_OPMETHOD(NAME, OP, REVERSE)                                 \
+  static Janet big_modint_##NAME(int32_t argc, Janet *argv) {                  \
+    return big_modint_binop(argc, argv, OP, REVERSE);                          \
+  }
+
+BIG_MODINT_OPMETHOD(add, '+', 0)
+BIG_MODINT_OPMETHOD(sub, '-', 0)
+BIG_MODINT_OPMETHOD(mul, '*', 0)
+BIG_MODINT_OPMETHOD(div, '/', 0)
+BIG_MODINT_OPMETHOD(radd, '+', 1)
+BIG_MODINT_OPMETHOD(rsub, '-', 1)
+BIG_MODINT_OPMETHOD(rmul, '*', 1)
+BIG_MODINT_OPMETHOD(rdiv, '/', 1)
+
+static JanetMethod big_modint_methods[] = {{"+", big_modint_add},
+                                           {"-", big_modint_sub},
+                                           {"*", big_modint_mul},
+                                           {"/", big_modint_div},
+                                           {"r+", big_modint_radd},
+                                           {"r-", big_modint_rsub},
+                                           {"r*", big_modint_rmul},
+                                           {"r/", big_modint_rdiv},
+                                           {NULL, NULL}};
+
+BIGINT_OPMETHOD(add, add, '+', a, b)
+BIGINT_OPMETHOD(sub, sub, '-', a, b)
+BIGINT_OPMETHOD(mul, mul, '*', a, b)
+//BIGINT_OPMETHOD(div, div, '/', a, b)
 BIGINT_LOGICMETHOD(and, logic_and, a, b)
 BIGINT_LOGICMETHOD(or, logic_or, a, b)
 BIGINT_LOGICMETHOD (xor, logic_xor, a, b)
 BIGINT_ROPMETHOD(radd, add, b, a)
 BIGINT_ROPMETHOD(rsub, sub, b, a)
 BIGINT_ROPMETHOD(rmul, mul, b, a)
-//BIGINT_OPMETHOD(rdiv, div, a, b)
+//BIGINT_OPMETHOD(rdiv, div, '/', a, b)
 BIGINT_RLOGICMETHOD(rand, logic_and, b, a)
 BIGINT_RLOGICMETHOD(ror, logic_or, b, a)
 BIGINT_RLOGICMETHOD(rxor, logic_xor, b, a)
@@ -491,21 +1799,123 @@ static JanetMethod big_int_methods[] = {{"+", big_int_add},
                                         {"compare", big_int_compare_meth},
                                         {NULL, NULL}};
 
-static int big_int_get(void *p, Janet key, Janet *out) {
-  (void)p;
+// Janet looks up every operator applied to a big/int or a big/modint
+// through the get hook, so the methods are found by the address of their
+// interned keyword in a small open addressing table per type instead of
+// comparing names one by one.  Keywords belong to the janet vm of a
+// thread, so every thread that loads the module builds its own tables.
+// The keywords are kept alive by a rooted owner object, whose finalizer
+// drops the tables when the vm is torn down (janet_deinit), so that a
+// later vm on the same thread builds new ones instead of comparing with
+// freed keywords.
+#define BIG_METHOD_SLOTS_LOG2 6
+#define BIG_METHOD_SLOTS (1 << BIG_METHOD_SLOTS_LOG2)
+
+typedef struct {
+  JanetKeyword name;
+  JanetCFunction cfun;
+} big_method_slot_t;
+
+typedef struct {
+  big_method_slot_t slots[BIG_METHOD_SLOTS];
+} big_method_table_t;
+
+static JANET_THREAD_LOCAL big_method_table_t big_int_method_table;
+static JANET_THREAD_LOCAL big_method_table_t big_modint_method_table;
+static JANET_THREAD_LOCAL int big_method_table_ok = 0;
+
+static size_t big_method_slot(JanetKeyword name) {
+  uint64_t h = (uint64_t) (uintptr_t) name * UINT64_C(0x9e3779b97f4a7c15);
+  return (size_t) (h >> (64 - BIG_METHOD_SLOTS_LOG2));
+}
+
+static int big_method_owner_gc(void *p, size_t len) {
+  (void) p;
+  (void) len;
+  big_method_table_ok = 0;
+  return 0;
+}
+
+static void big_method_table_mark(const big_method_table_t *t) {
+  for (size_t i = 0; i < BIG_METHOD_SLOTS; i++) {
+    if (t->slots[i].name != NULL)
+      janet_mark(janet_wrap_keyword(t->slots[i].name));
+  }
+}
+
+static int big_method_owner_mark(void *p, size_t len) {
+  (void) p;
+  (void) len;
+  big_method_table_mark(&big_int_method_table);
+  big_method_table_mark(&big_modint_method_table);
+  return 0;
+}
+
+static const JanetAbstractType big_method_owner_type = {
+  "big/method-table",
+  big_method_owner_gc,
+  big_method_owner_mark,
+  JANET_ATEND_GCMARK
+};
+
+static void big_method_table_fill(big_method_table_t *t, const JanetMethod *methods) {
+  memset(t, 0, sizeof(big_method_table_t));
+  for (; methods->name != NULL; methods++) {
+    JanetKeyword name = janet_ckeyword(methods->name);
+    size_t i = big_method_slot(name);
+    while (t->slots[i].name != NULL)
+      i = (i + 1) & (BIG_METHOD_SLOTS - 1);
+    t->slots[i].name = name;
+    t->slots[i].cfun = methods->cfun;
+  }
+}
+
+static void big_method_table_init(void) {
+  // loading the module again in the same vm keeps the tables
+  if (big_method_table_ok)
+    return;
+  big_method_table_fill(&big_int_method_table, big_int_methods);
+  big_method_table_fill(&big_modint_method_table, big_modint_methods);
+  janet_gcroot(janet_wrap_abstract(janet_abstract(&big_method_owner_type, 1)));
+  big_method_table_ok = 1;
+}
+
+static int big_method_get(const big_method_table_t *t, const JanetMethod *methods,
+                          Janet key, Janet *out) {
   if (!janet_checktype(key, JANET_KEYWORD))
     return 0;
-  return janet_getmethod(janet_unwrap_keyword(key), big_int_methods, out);
+  JanetKeyword name = janet_unwrap_keyword(key);
+  // a thread that got big values without loading the module has no table
+  if (!big_method_table_ok)
+    return janet_getmethod(name, methods, out);
+  for (size_t i = big_method_slot(name); t->slots[i].name != NULL;
+       i = (i + 1) & (BIG_METHOD_SLOTS - 1)) {
+    if (t->slots[i].name == name) {
+      *out = janet_wrap_cfunction(t->slots[i].cfun);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int big_int_get(void *p, Janet key, Janet *out) {
+  (void)p;
+  return big_method_get(&big_int_method_table, big_int_methods, key, out);
+}
+
+static int big_modint_get(void *p, Janet key, Janet *out) {
+  (void)p;
+  return big_method_get(&big_modint_method_table, big_modint_methods, key, out);
 }
 
 static Janet big_int_pow(int32_t argc, Janet *argv) {
   janet_fixarity(argc, 2);
-  bf_t *x = big_coerce_janet_to_int(argv, 0);
-  bf_t *y = big_coerce_janet_to_int(argv, 1);
+  big_tmp_t xtmp, ytmp;
+  bf_t *x = big_coerce_janet_to_int(argv, 0, &xtmp);
+  bf_t *y = big_coerce_janet_to_int(argv, 1, &ytmp);
   if (y->sign)
     janet_panicf("big/pow called with negative exponent");
-  bf_t *r = janet_abstract(&big_int_type, sizeof(bf_t));
-  bf_init(&bf_ctx, r);
+  bf_t *r = big_int_alloc();
   int e = bf_pow(r, x, y, BF_PREC_INF, BF_RNDZ);
   if (e == BF_ST_INVALID_OP)
     janet_panicf("big/pow invalid operand");
@@ -514,37 +1924,184 @@ static Janet big_int_pow(int32_t argc, Janet *argv) {
 
 static Janet big_int_sqrt(int32_t argc, Janet *argv) {
   janet_fixarity(argc, 1);
-  bf_t *x = big_coerce_janet_to_int(argv, 0);
-  bf_t *r = janet_abstract(&big_int_type, sizeof(bf_t));
-  bf_init(&bf_ctx, r);
+  big_tmp_t xtmp;
+  bf_t *x = big_coerce_janet_to_int(argv, 0, &xtmp);
+  bf_t *r = big_int_alloc();
   int e = bf_sqrtrem(r, NULL, x);
   if (e == BF_ST_INVALID_OP)
     janet_panicf("big/sqrt invalid operand");
   return janet_wrap_abstract(r);
 }
 
+// Scratch buffers bigger than this are freed after an in-place operation
+// rather than kept around by the thread for the next one.
+#define BIG_SCRATCH_KEEP_LIMBS 4096
+
+// Exchanges the values of two big/ints, keeping each one's inline limbs
+// in place.
+static void big_swap(bf_inline_t *x, bf_inline_t *y) {
+  bf_inline_t t = *x;
+  if (t.b.tab == x->inline_tab)
+    t.b.tab = t.inline_tab;
+  x->b.sign = y->b.sign;
+  x->b.expn = y->b.expn;
+  x->b.len = y->b.len;
+  if (bf_tab_is_inline(&y->b)) {
+    memcpy(x->inline_tab, y->inline_tab, sizeof(x->inline_tab));
+    x->b.tab = x->inline_tab;
+  } else {
+    x->b.tab = y->b.tab;
+  }
+  y->b.sign = t.b.sign;
+  y->b.expn = t.b.expn;
+  y->b.len = t.b.len;
+  if (t.b.tab == t.inline_tab) {
+    memcpy(y->inline_tab, t.inline_tab, sizeof(y->inline_tab));
+    y->b.tab = y->inline_tab;
+  } else {
+    y->b.tab = t.b.tab;
+  }
+}
+
+typedef int (*big_op2_t)(bf_t *r, const bf_t *a, const bf_t *b, limb_t prec, bf_flags_t flags);
+
+// Replaces argv[0] with OP(argv[0], argv[1]) and returns it.  libbf
+// can't write a sum or product over one of its operands without a
+// temporary, so the result goes into the thread's scratch number which
+// is then swapped with the accumulator.  The scratch keeps the old limbs
+// for the next call, so a loop of updates reuses the same two buffers
+// instead of creating a new big/int each time.  The cached hash of the
+// accumulator is dropped.
+static Janet big_int_update(int32_t argc, Janet *argv, big_op2_t op, const char *name) {
+  janet_fixarity(argc, 2);
+  big_int_t *acc = (big_int_t *)janet_getabstract(argv, 0, &big_int_type);
+  big_tmp_t tmp;
+  bf_t *x = big_coerce_janet_to_int(argv, 1, &tmp);
+  bf_inline_t *scratch = &big_state()->scratch;
+  if (op(&scratch->b, &acc->bi.b, x, BF_PREC_INF, BF_RNDZ) & BF_ST_MEM_ERROR)
+    janet_panicf("%s out of memory", name);
+  big_swap(&acc->bi, scratch);
+  acc->hash_ok = 0;
+  if (scratch->b.len > BIG_SCRATCH_KEEP_LIMBS)
+    bf_set_zero(&scratch->b, 0);
+  return argv[0];
+}
+
+static Janet big_int_add_inplace(int32_t argc, Janet *argv) {
+  return big_int_update(argc, argv, bf_add, "big/add!");
+}
+
+static Janet big_int_sub_inplace(int32_t argc, Janet *argv) {
+  return big_int_update(argc, argv, bf_sub, "big/sub!");
+}
+
+static Janet big_int_mul_inplace(int32_t argc, Janet *argv) {
+  return big_int_update(argc, argv, bf_mul, "big/mul!");
+}
+
+static Janet big_int_inc_inplace(int32_t argc, Janet *argv) {
+  janet_fixarity(argc, 1);
+  Janet args[2] = {argv[0], janet_wrap_number(1)};
+  return big_int_update(2, args, bf_add, "big/inc!");
+}
+
+static Janet big_set_threads(int32_t argc, Janet *argv) {
+  janet_arity(argc, 1, 2);
+  int32_t n = janet_getinteger(argv, 0);
+  if (n < 1 || n > BIG_POOL_MAX_THREADS + 1)
+    janet_panicf("thread count must be between 1 and %d, got %d",
+                 BIG_POOL_MAX_THREADS + 1, n);
+  int32_t min_limbs = janet_optnat(argv, argc, 1, BIG_POOL_DEFAULT_MIN_LIMBS);
+  return janet_wrap_integer(big_pool_resize(n, (limb_t) min_limbs) + 1);
+}
+
 static const JanetReg cfuns[] = {
   {"int", big_int,
-    "(big/int v)\n\n"
-      "Create a new big/int with value of v -- which can be another big/int, a Janet number, int/u64, int/s64, or a string representing a decimal number.  In other functions in this module, arguments can generally be any of the above, except strings.  Strings are only accepted in big/int."},
+    "(big/int v &opt radix)\n\n"
+      "Create a new big/int with value of v -- which can be another big/int, a Janet number, int/u64, int/s64, or a string representing a number in radix (2 to 36, default 10, digits past 9 are letters in either case, no prefix).  In other functions in this module, arguments can generally be any of the above, except strings.  Strings are only accepted in big/int."},
+  {"to-string", big_int_to_string_radix,
+    "(big/to-string x &opt radix)\n\n"
+      "Return x as a string in radix (2 to 36, default 10), with lower case letters for the digits past 9 and no prefix.  Radixes 2, 4, 8, 16 and 32 take linear time."},
+  {"to-bytes", big_int_to_bytes,
+    "(big/to-bytes x &opt order width signed buf)\n\n"
+      "Write x as a binary integer of width bytes to buf (default a new buffer) and return buf.  order is :be (the default), :le or :native.  Without width, the fewest bytes that hold x are used (one for 0).  With signed, x is written in two's complement, otherwise it must not be negative.  Panics if x does not fit in width bytes."},
+  {"from-bytes", big_int_from_bytes,
+    "(big/from-bytes bytes &opt order signed)\n\n"
+      "Create a new big/int from the binary integer in the string or buffer bytes.  order is :be (the default), :le or :native.  With signed, bytes is read as two's complement, otherwise as an unsigned magnitude.  Empty bytes give 0."},
   {"divrem", big_int_divrem,
     "(big/divrem x y)\n\n"
       "Divide x by y, returning [quotient, remainder] as big/ints. (y != 0)"},
   {"divmod", big_int_divmod,
     "(big/divmod x y)\n\n"
       "Divide x by y, returning [quotient, mod(x,y)] as big/ints. (y != 0)"},
+  {"divisor", big_divisor,
+    "(big/divisor d)\n\n"
+      "Prepare the nonzero integer d for repeated division with big/div-by, big/rem-by and big/divmod-by.  The work done once here (normalizing d and computing its reciprocal) is then saved on every division, which pays off most for large d."},
+  {"div-by", big_int_div_by,
+    "(big/div-by x divisor)\n\n"
+      "Same as (/ x d) for the big/divisor made from d."},
+  {"rem-by", big_int_rem_by,
+    "(big/rem-by x divisor)\n\n"
+      "Same as (% x d) for the big/divisor made from d."},
+  {"divmod-by", big_int_divmod_by,
+    "(big/divmod-by x divisor)\n\n"
+      "Same as (big/divmod x d) for the big/divisor made from d."},
+  {"gcd", big_int_gcd,
+    "(big/gcd x y)\n\n"
+      "Create a new big/int equal to the greatest common divisor of x and y, which is never negative.  (big/gcd 0 0) is 0."},
+  {"lcm", big_int_lcm,
+    "(big/lcm x y)\n\n"
+      "Create a new big/int equal to the least common multiple of x and y, which is never negative.  It is 0 when x or y is 0."},
+  {"gcdext", big_int_gcdext,
+    "(big/gcdext x y)\n\n"
+      "Extended gcd: return [g u v] as big/ints, with g the gcd of x and y and g = u*x + v*y, where |u| <= |y|/(2g) so that the cofactors are the smallest ones."},
+  {"modulus", big_modulus,
+    "(big/modulus m)\n\n"
+      "Prepare the positive integer m as the modulus of big/powmod.  Reusing it saves the setup of the modular reduction on every call."},
+  {"powmod", big_int_powmod,
+    "(big/powmod x e m)\n\n"
+      "Create a new big/int equal to x raised to the e power modulo m, between 0 and m - 1, without computing the full power.  m is a positive integer or a big/modulus.  (e >= 0)"},
+  {"invmod", big_int_invmod,
+    "(big/invmod x m)\n\n"
+      "Create a new big/int equal to the inverse of x modulo m, between 0 and m - 1.  m is a positive integer or a big/modulus.  Raise an error if x and m are not coprime."},
+  {"invmod-many", big_int_invmod_many,
+    "(big/invmod-many xs m)\n\n"
+      "Return an array of the inverses of the values in xs modulo m, as by big/invmod, at the cost of one inversion and 3 multiplications modulo m per value.  m is a positive integer or a big/modulus.  Raise an error if one of the values is not invertible."},
+  {"modint", big_modint,
+    "(big/modint x m)\n\n"
+      "Create a big/modint, the integer x modulo m, where m is a big/modulus or a positive integer.  The operators + - * and / between a big/modint and another of the same modulus, or an integer, give a big/modint reduced modulo m; / multiplies by the modular inverse.  Use big/int for the value, between 0 and m - 1."},
   {"pow", big_int_pow,
     "(big/pow x y)\n\n"
       "Create a new big/int equal to x raised to the y power.  (y >= 0)"},
   {"sqrt", big_int_sqrt,
     "(big/sqrt x)\n\n"
       "Create a new big/int equal to the integer portion of the square root of x. (x bigint >= 0)"},
+  {"add!", big_int_add_inplace,
+    "(big/add! acc x)\n\n"
+      "Add x to the big/int acc in place, returning acc.  Every reference to acc sees the new value, so don't use it on a big/int that is shared.  Never update a big/int that is a key of a table or struct: the table keeps it under its old hash and won't find it anymore.  Note that (big/int acc) returns acc itself, not a copy."},
+  {"sub!", big_int_sub_inplace,
+    "(big/sub! acc x)\n\n"
+      "Subtract x from the big/int acc in place, returning acc.  It must not be shared or be a table key, see big/add!."},
+  {"mul!", big_int_mul_inplace,
+    "(big/mul! acc x)\n\n"
+      "Multiply the big/int acc by x in place, returning acc.  It must not be shared or be a table key, see big/add!."},
+  {"inc!", big_int_inc_inplace,
+    "(big/inc! acc)\n\n"
+      "Add one to the big/int acc in place, returning acc.  It must not be shared or be a table key, see big/add!."},
+  {"set-threads", big_set_threads,
+    "(big/set-threads n &opt min-limbs)\n\n"
+      "Use up to n threads, counting the calling one, to multiply big/ints whose product has at least min-limbs 64-bit limbs (default 20000, about 385000 decimal digits).  The worker pool is shared by all threads; n = 1 turns it off, which is the default.  Returns the number of threads actually available."},
   {NULL, NULL, NULL}};
 
 JANET_MODULE_ENTRY(JanetTable *env) {
-  bf_context_init(&bf_ctx, big_bf_realloc, NULL);
+  // Pick the vector NTT when the host supports it, before any big/int
+  // is multiplied.
+  bf_ntt_select();
   janet_cfuns(env, "big", cfuns);
   janet_register_abstract_type(&big_int_type);
+  janet_register_abstract_type(&big_modulus_type);
+  janet_register_abstract_type(&big_modint_type);
+  big_method_table_init();
 }
 
 // vim: ts=2:sts=2:sw=2:et:
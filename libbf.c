@@ -28,10 +28,6 @@
 #include <string.h>
 #include <assert.h>
 
-#ifdef __AVX2__
-#include <immintrin.h>
-#endif
-
 #include "cutils.h"
 #include "libbf.h"
 
@@ -44,15 +40,50 @@
 
 //#define inline __attribute__((always_inline))
 
-#ifdef __AVX2__
-#define FFT_MUL_THRESHOLD 100 /* in limbs of the smallest factor */
+#if defined(__AVX2__) || defined(LIBBF_AVX2_NTT)
+/* floating point NTT using AVX2 */
+#define NTT_AVX2
+#include <immintrin.h>
+#elif defined(USE_FFT_MUL) && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__))
+/* the AVX2 NTT is compiled by libbf_avx2.c and selected at run time
+   by bf_ntt_select() */
+#define NTT_DISPATCH
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+/* vectorized decimal output */
+#define LIMB_TO_A_SSE2
+#include <emmintrin.h>
+#endif
+
+/* in limbs of the smallest factor */
+#define FFT_MUL_THRESHOLD_AVX2 200
+#define FFT_MUL_THRESHOLD_SCALAR 500
+#if defined(NTT_AVX2)
+#define FFT_MUL_THRESHOLD FFT_MUL_THRESHOLD_AVX2
+#elif defined(NTT_DISPATCH)
+#define FFT_MUL_THRESHOLD (bf_ntt_avx2 ? FFT_MUL_THRESHOLD_AVX2 : \
+                           FFT_MUL_THRESHOLD_SCALAR)
 #else
-#define FFT_MUL_THRESHOLD 100 /* in limbs of the smallest factor */
+#define FFT_MUL_THRESHOLD FFT_MUL_THRESHOLD_SCALAR
 #endif
 
+/* in limbs of the smallest factor, measured on x86-64 with
+   perf/mul_tune.c. Must be >= 8 so that the recursion terminates. */
+#define KARATSUBA_MUL_THRESHOLD 24
+#define KARATSUBA_SQR_THRESHOLD 48
+#define TOOM3_MUL_THRESHOLD 160
+#define TOOM3_SQR_THRESHOLD 160
+
 /* XXX: adjust */
 #define DIVNORM_LARGE_THRESHOLD 50
 #define UDIV1NORM_THRESHOLD 3
+/* in limbs of the modulus: Montgomery reduction with two products
+   instead of one limb at a time */
+#define REDC_MUL_THRESHOLD 100
+/* in bits still to remove: half-GCD recursion instead of Lehmer steps */
+#define HGCD_THRESHOLD (80 * LIMB_BITS)
 
 #if LIMB_BITS == 64
 #define FMT_LIMB1 "%" PRIx64 
@@ -84,8 +115,18 @@ static no_inline int fft_mul(bf_context_t *s,
                              bf_t *res, limb_t *a_tab, limb_t a_len,
                              limb_t *b_tab, limb_t b_len, int mul_flags);
 static void fft_clear_cache(bf_context_t *s);
+#ifdef NTT_DISPATCH
+static int bf_ntt_avx2; /* TRUE if the AVX2 NTT is selected */
 #endif
-#ifdef USE_BF_DEC
+#if defined(NTT_DISPATCH) || defined(LIBBF_AVX2_NTT)
+/* entry points of libbf_avx2.c */
+int fft_mul_avx2(bf_context_t *s, bf_t *res, limb_t *a_tab, limb_t a_len,
+                 limb_t *b_tab, limb_t b_len, int mul_flags);
+void fft_clear_cache_avx2(bf_context_t *s);
+int bf_get_fft_size_avx2(int *pdpl, int *pnb_mods, limb_t len);
+#endif
+#endif
+#if defined(USE_BF_DEC) && !defined(LIBBF_AVX2_NTT)
 static limb_t get_digit(const limb_t *tab, limb_t len, slimb_t pos);
 #endif
 
@@ -164,10 +205,37 @@ static inline slimb_t sat_add(slimb_t a, slimb_t b)
     return r;
 }
 
+/* get LIMB_BITS at bit position 'pos' in tab */
+static inline limb_t get_bits(const limb_t *tab, limb_t len, slimb_t pos)
+{
+    limb_t i, a0, a1;
+    int p;
+
+    i = pos >> LIMB_LOG2_BITS;
+    p = pos & (LIMB_BITS - 1);
+    if (i < len)
+        a0 = tab[i];
+    else
+        a0 = 0;
+    if (p == 0) {
+        return a0;
+    } else {
+        i++;
+        if (i < len)
+            a1 = tab[i];
+        else
+            a1 = 0;
+        return (a0 >> p) | (a1 << (LIMB_BITS - p));
+    }
+}
+
 #define malloc(s) malloc_is_forbidden(s)
 #define free(p) free_is_forbidden(p)
 #define realloc(p, s) realloc_is_forbidden(p, s)
 
+/* libbf_avx2.c only compiles the NTT */
+#ifndef LIBBF_AVX2_NTT
+
 void bf_context_init(bf_context_t *s, bf_realloc_func_t *realloc_func,
                      void *realloc_opaque)
 {
@@ -185,21 +253,40 @@ void bf_init(bf_context_t *s, bf_t *r)
 {
     r->ctx = s;
     r->sign = 0;
+    r->has_inline = FALSE;
     r->expn = BF_EXP_ZERO;
     r->len = 0;
     r->tab = NULL;
 }
 
+void bf_init_inline(bf_context_t *s, bf_inline_t *r)
+{
+    bf_init(s, &r->b);
+    r->b.has_inline = TRUE;
+    r->b.tab = r->inline_tab;
+}
+
 /* return 0 if OK, -1 if alloc error */
 int bf_resize(bf_t *r, limb_t len)
 {
     limb_t *tab;
     
     if (len != r->len) {
-        tab = bf_realloc(r->ctx, r->tab, len * sizeof(limb_t));
-        if (!tab && len != 0)
-            return -1;
-        r->tab = tab;
+        if (bf_tab_is_inline(r)) {
+            if (len > BF_INLINE_LIMBS) {
+                /* move to the heap */
+                tab = bf_malloc(r->ctx, len * sizeof(limb_t));
+                if (!tab)
+                    return -1;
+                memcpy(tab, r->tab, bf_min(r->len, len) * sizeof(limb_t));
+                r->tab = tab;
+            }
+        } else {
+            tab = bf_realloc(r->ctx, r->tab, len * sizeof(limb_t));
+            if (!tab && len != 0)
+                return -1;
+            r->tab = tab;
+        }
         r->len = len;
     }
     return 0;
@@ -300,10 +387,31 @@ int bf_set(bf_t *r, const bf_t *a)
 void bf_move(bf_t *r, bf_t *a)
 {
     bf_context_t *s = r->ctx;
+    int has_inline;
+
     if (r == a)
         return;
-    bf_free(s, r->tab);
+    if (bf_tab_is_inline(a)) {
+        bf_set(r, a);
+        return;
+    }
+    if (bf_tab_is_inline(r)) {
+        if (a->len <= BF_INLINE_LIMBS) {
+            /* keep the inline storage */
+            if (a->len != 0)
+                memcpy(r->tab, a->tab, a->len * sizeof(limb_t));
+            r->sign = a->sign;
+            r->expn = a->expn;
+            r->len = a->len;
+            bf_free(s, a->tab);
+            return;
+        }
+    } else {
+        bf_free(s, r->tab);
+    }
+    has_inline = r->has_inline;
     *r = *a;
+    r->has_inline = has_inline;
 }
 
 static limb_t get_limbz(const bf_t *a, limb_t idx)
@@ -314,30 +422,6 @@ static limb_t get_limbz(const bf_t *a, limb_t idx)
         return a->tab[idx];
 }
 
-/* get LIMB_BITS at bit position 'pos' in tab */
-static inline limb_t get_bits(const limb_t *tab, limb_t len, slimb_t pos)
-{
-    limb_t i, a0, a1;
-    int p;
-
-    i = pos >> LIMB_LOG2_BITS;
-    p = pos & (LIMB_BITS - 1);
-    if (i < len)
-        a0 = tab[i];
-    else
-        a0 = 0;
-    if (p == 0) {
-        return a0;
-    } else {
-        i++;
-        if (i < len)
-            a1 = tab[i];
-        else
-            a1 = 0;
-        return (a0 >> p) | (a1 << (LIMB_BITS - p));
-    }
-}
-
 static inline limb_t get_bit(const limb_t *tab, limb_t len, slimb_t pos)
 {
     slimb_t i;
@@ -1157,6 +1241,23 @@ static limb_t mp_add_mul1(limb_t *tabr, const limb_t *taba, limb_t n,
     return l;
 }
 
+/* tabr[] -= taba[] * b. Return the value to substract to the high
+   word. */
+static limb_t mp_sub_mul1(limb_t *tabr, const limb_t *taba, limb_t n,
+                          limb_t b)
+{
+    limb_t i, l;
+    dlimb_t t;
+    
+    l = 0;
+    for(i = 0; i < n; i++) {
+        t = tabr[i] - (dlimb_t)taba[i] * (dlimb_t)b - l;
+        tabr[i] = t;
+        l = -(t >> LIMB_BITS);
+    }
+    return l;
+}
+
 /* size of the result : op1_size + op2_size. */
 static void mp_mul_basecase(limb_t *result, 
                             const limb_t *op1, limb_t op1_size, 
@@ -1171,6 +1272,322 @@ static void mp_mul_basecase(limb_t *result,
     }
 }
 
+/* size of the result : 2 * n. Each cross product op[i] * op[j] with
+   i < j is computed once and doubled, then the squares op[i]^2 are
+   added. */
+static void mp_sqr_basecase(limb_t *result, const limb_t *op, limb_t n)
+{
+    limb_t i, c;
+    dlimb_t t, u;
+
+    /* cross products */
+    result[0] = 0;
+    result[n] = mp_mul1(result + 1, op + 1, n - 1, op[0], 0);
+    for(i = 1; i < n - 1; i++) {
+        result[n + i] = mp_add_mul1(result + 2 * i + 1, op + i + 1,
+                                    n - i - 1, op[i]);
+    }
+    result[2 * n - 1] = 0;
+    /* double them */
+    mp_add(result, result, result, 2 * n, 0);
+    /* add the squares */
+    c = 0;
+    for(i = 0; i < n; i++) {
+        t = (dlimb_t)op[i] * op[i];
+        u = (dlimb_t)result[2 * i] + (limb_t)t + c;
+        result[2 * i] = u;
+        u = (dlimb_t)result[2 * i + 1] + (limb_t)(t >> LIMB_BITS) +
+            (limb_t)(u >> LIMB_BITS);
+        result[2 * i + 1] = u;
+        c = u >> LIMB_BITS;
+    }
+}
+
+/* return -1, 0 or 1 */
+static int mp_cmp(const limb_t *taba, const limb_t *tabb, mp_size_t n)
+{
+    mp_size_t i;
+    for(i = n - 1; i >= 0; i--) {
+        if (taba[i] != tabb[i]) {
+            if (taba[i] < tabb[i])
+                return -1;
+            else
+                return 1;
+        }
+    }
+    return 0;
+}
+
+/* tab[] = tab[] / 3 modulo B^n. 'tab' must be a multiple of 3. */
+static void mp_divexact3(limb_t *tab, limb_t n)
+{
+    limb_t i, a, t, c, c1, inv3;
+
+    inv3 = (limb_t)-1 / 3 * 2 + 1; /* 3 * inv3 = 1 modulo B */
+    c = 0;
+    for(i = 0; i < n; i++) {
+        a = tab[i];
+        t = a - c;
+        c1 = t > a;
+        t = t * inv3;
+        tab[i] = t;
+        c = (limb_t)(((dlimb_t)t * 3) >> LIMB_BITS) + c1;
+    }
+}
+
+/* res[0..n1) = op1[0..n1) + op2[0..n2) with n1 >= n2. Return the carry. */
+static limb_t mp_add2(limb_t *res, const limb_t *op1, limb_t n1,
+                      const limb_t *op2, limb_t n2)
+{
+    limb_t c;
+    c = mp_add(res, op1, op2, n2, 0);
+    if (res != op1)
+        memcpy(res + n2, op1 + n2, (n1 - n2) * sizeof(limb_t));
+    return mp_add_ui(res + n2, c, n1 - n2);
+}
+
+/* tab[0..n) += op[0..op_len). The limbs of 'op' and the carry past
+   'n' limbs must be zero. */
+static void mp_add_trunc(limb_t *tab, limb_t n, const limb_t *op,
+                         limb_t op_len)
+{
+    limb_t c;
+    op_len = bf_min(op_len, n);
+    c = mp_add(tab, tab, op, op_len, 0);
+    mp_add_ui(tab + op_len, c, n - op_len);
+}
+
+/* tab[0..n) -= op[0..op_len) modulo B^n, op_len <= n */
+static void mp_sub_trunc(limb_t *tab, limb_t n, const limb_t *op,
+                         limb_t op_len)
+{
+    limb_t c;
+    c = mp_sub(tab, tab, op, op_len, 0);
+    mp_sub_ui(tab + op_len, c, n - op_len);
+}
+
+static void mp_mul_toom(limb_t *result, const limb_t *op1, limb_t op1_size,
+                        const limb_t *op2, limb_t op2_size, limb_t *tmp);
+
+/* Karatsuba: (a1*B^h+a0)*(b1*B^h+b0) with 
+   a1*b0+a0*b1 = (a0+a1)*(b0+b1)-a0*b0-a1*b1. h < n2 <= n1. Uses 4*h+4
+   limbs of 'tmp' before recursing. */
+static void mp_mul_karatsuba(limb_t *result,
+                             const limb_t *op1, limb_t n1,
+                             const limb_t *op2, limb_t n2,
+                             limb_t h, limb_t *tmp)
+{
+    limb_t *sa, *sb, *z, n;
+    int is_sqr = (op1 == op2 && n1 == n2);
+    
+    n = n1 + n2;
+    sa = tmp;
+    sb = sa + h + 1;
+    z = sb + h + 1;
+    tmp = z + 2 * h + 2;
+    sa[h] = mp_add2(sa, op1, h, op1 + h, n1 - h);
+    if (is_sqr) {
+        sb = sa;
+    } else {
+        sb[h] = mp_add2(sb, op2, h, op2 + h, n2 - h);
+    }
+    mp_mul_toom(z, sa, h + 1, sb, h + 1, tmp);
+    mp_mul_toom(result, op1, h, op2, h, tmp);
+    mp_mul_toom(result + 2 * h, op1 + h, n1 - h, op2 + h, n2 - h, tmp);
+    mp_sub_trunc(z, 2 * h + 2, result, 2 * h);
+    mp_sub_trunc(z, 2 * h + 2, result + 2 * h, n - 2 * h);
+    mp_add_trunc(result + h, n - h, z, 2 * h + 2);
+}
+
+/* Toom-3 with the evaluation points 0, 1, -1, 2 and infinity. The
+   operands are cut in k limb pieces with 2 * k < n2 <= n1. The
+   interpolation is done modulo B^(2*k+2) where all the coefficients
+   fit. Uses 8*k+8 limbs of 'tmp' before recursing. */
+static void mp_mul_toom3(limb_t *result,
+                         const limb_t *op1, limb_t n1,
+                         const limb_t *op2, limb_t n2,
+                         limb_t k, limb_t *tmp)
+{
+    limb_t *v1, *vm1, *v2, *ea, *eb, *c4, l, n, n4;
+    int is_sqr = (op1 == op2 && n1 == n2);
+    int sa, sb;
+    const limb_t *a0, *a1, *a2, *b0, *b1, *b2;
+    
+    n = n1 + n2;
+    l = 2 * k + 2;
+    v1 = tmp;
+    vm1 = v1 + l;
+    v2 = vm1 + l;
+    ea = v2 + l;
+    eb = ea + k + 1;
+    tmp = eb + k + 1;
+    a0 = op1;
+    a1 = op1 + k;
+    a2 = op1 + 2 * k;
+    b0 = op2;
+    b1 = op2 + k;
+    b2 = op2 + 2 * k;
+    
+    /* -1: (a0 + a2) - a1 */
+    ea[k] = mp_add2(ea, a0, k, a2, n1 - 2 * k);
+    sa = (ea[k] == 0 && mp_cmp(ea, a1, k) < 0);
+    if (sa)
+        mp_sub(ea, a1, ea, k, 0);
+    else
+        ea[k] -= mp_sub(ea, ea, a1, k, 0);
+    if (is_sqr) {
+        eb = ea;
+        sb = sa;
+    } else {
+        eb[k] = mp_add2(eb, b0, k, b2, n2 - 2 * k);
+        sb = (eb[k] == 0 && mp_cmp(eb, b1, k) < 0);
+        if (sb)
+            mp_sub(eb, b1, eb, k, 0);
+        else
+            eb[k] -= mp_sub(eb, eb, b1, k, 0);
+    }
+    mp_mul_toom(vm1, ea, k + 1, eb, k + 1, tmp);
+    if (sa ^ sb)
+        mp_neg(vm1, vm1, l, 0);
+    
+    /* 1: a0 + a1 + a2 */
+    ea[k] = mp_add2(ea, a0, k, a2, n1 - 2 * k);
+    ea[k] += mp_add(ea, ea, a1, k, 0);
+    if (!is_sqr) {
+        eb[k] = mp_add2(eb, b0, k, b2, n2 - 2 * k);
+        eb[k] += mp_add(eb, eb, b1, k, 0);
+    }
+    mp_mul_toom(v1, ea, k + 1, eb, k + 1, tmp);
+    
+    /* 2: a0 + 2 * a1 + 4 * a2 */
+    memcpy(ea, a0, k * sizeof(limb_t));
+    ea[k] = mp_add_mul1(ea, a1, k, 2);
+    mp_add_ui(ea + n1 - 2 * k, mp_add_mul1(ea, a2, n1 - 2 * k, 4),
+              3 * k + 1 - n1);
+    if (!is_sqr) {
+        memcpy(eb, b0, k * sizeof(limb_t));
+        eb[k] = mp_add_mul1(eb, b1, k, 2);
+        mp_add_ui(eb + n2 - 2 * k, mp_add_mul1(eb, b2, n2 - 2 * k, 4),
+                  3 * k + 1 - n2);
+    }
+    mp_mul_toom(v2, ea, k + 1, eb, k + 1, tmp);
+    
+    /* 0 and infinity */
+    c4 = result + 4 * k;
+    n4 = n - 4 * k;
+    mp_mul_toom(result, a0, k, b0, k, tmp);
+    mp_mul_toom(c4, a2, n1 - 2 * k, b2, n2 - 2 * k, tmp);
+    
+    /* interpolation */
+    mp_sub(vm1, v1, vm1, l, 0);
+    mp_shr(vm1, vm1, l, 1, 0); /* c1 + c3 */
+    mp_sub(v1, v1, vm1, l, 0);
+    mp_sub_trunc(v1, l, result, 2 * k);
+    mp_sub_trunc(v1, l, c4, n4); /* c2 */
+    mp_sub_trunc(v2, l, result, 2 * k);
+    mp_sub_mul1(v2, v1, l, 4);
+    mp_sub_ui(v2 + n4, mp_sub_mul1(v2, c4, n4, 16), l - n4);
+    mp_shr(v2, v2, l, 1, 0);
+    mp_sub(v2, v2, vm1, l, 0);
+    mp_divexact3(v2, l); /* c3 */
+    mp_sub(vm1, vm1, v2, l, 0); /* c1 */
+    
+    /* recomposition */
+    memset(result + 2 * k, 0, 2 * k * sizeof(limb_t));
+    mp_add_trunc(result + k, n - k, vm1, l);
+    mp_add_trunc(result + 2 * k, n - 2 * k, v1, l);
+    mp_add_trunc(result + 3 * k, n - 3 * k, v2, l);
+}
+
+/* size of the result : op1_size + op2_size. 'tmp' must contain
+   mp_mul_toom_tmp_size(max(op1_size, op2_size)) limbs. */
+static void mp_mul_toom(limb_t *result, const limb_t *op1, limb_t op1_size,
+                        const limb_t *op2, limb_t op2_size, limb_t *tmp)
+{
+    limb_t n1, n2, h, k, i, l, *t;
+    const limb_t *a, *b;
+    int is_sqr;
+
+    if (op1_size >= op2_size) {
+        a = op1;
+        n1 = op1_size;
+        b = op2;
+        n2 = op2_size;
+    } else {
+        a = op2;
+        n1 = op2_size;
+        b = op1;
+        n2 = op1_size;
+    }
+    is_sqr = (a == b && n1 == n2);
+    if (n2 < (is_sqr ? KARATSUBA_SQR_THRESHOLD : KARATSUBA_MUL_THRESHOLD)) {
+        if (is_sqr)
+            mp_sqr_basecase(result, a, n1);
+        else
+            mp_mul_basecase(result, a, n1, b, n2);
+        return;
+    }
+    k = (n1 + 2) / 3;
+    if (n2 >= (is_sqr ? TOOM3_SQR_THRESHOLD : TOOM3_MUL_THRESHOLD) &&
+        n2 > 2 * k) {
+        mp_mul_toom3(result, a, n1, b, n2, k, tmp);
+        return;
+    }
+    h = (n1 + 1) / 2;
+    if (n2 > h) {
+        mp_mul_karatsuba(result, a, n1, b, n2, h, tmp);
+        return;
+    }
+    /* unbalanced: multiply 'b' by n2 limb slices of 'a' */
+    t = tmp;
+    tmp += 2 * n2;
+    mp_mul_toom(result, a, n2, b, n2, tmp);
+    for(i = n2; i < n1; i += n2) {
+        l = bf_min(n2, n1 - i);
+        mp_mul_toom(t, a + i, l, b, n2, tmp);
+        memcpy(result + i + n2, t + n2, l * sizeof(limb_t));
+        mp_add_ui(result + i + n2, mp_add(result + i, result + i, t, n2, 0),
+                  l);
+    }
+}
+
+/* upper bound of the number of temporary limbs used by mp_mul_toom()
+   when the largest operand has n limbs */
+static limb_t mp_mul_toom_tmp_size(limb_t n)
+{
+    limb_t s = 0;
+    while (n >= bf_min(KARATSUBA_MUL_THRESHOLD, KARATSUBA_SQR_THRESHOLD)) {
+        s += 4 * n + 8;
+        n = n / 2 + 2;
+    }
+    return s;
+}
+
+/* size of the result : op1_size + op2_size. Return 0 if OK, -1 if
+   memory error. */
+static int mp_mul_nofft(bf_context_t *s, limb_t *result,
+                        const limb_t *op1, limb_t op1_size,
+                        const limb_t *op2, limb_t op2_size)
+{
+    limb_t *tmp, n2;
+    
+    n2 = bf_min(op1_size, op2_size);
+    if (n2 < bf_min(KARATSUBA_MUL_THRESHOLD, KARATSUBA_SQR_THRESHOLD)) {
+        if (op1 == op2 && op1_size == op2_size)
+            mp_sqr_basecase(result, op1, op1_size);
+        else
+            mp_mul_basecase(result, op1, op1_size, op2, op2_size);
+        return 0;
+    }
+    tmp = bf_malloc(s, sizeof(limb_t) *
+                    mp_mul_toom_tmp_size(bf_max(op1_size, op2_size)));
+    if (!tmp)
+        return -1;
+    mp_mul_toom(result, op1, op1_size, op2, op2_size, tmp);
+    bf_free(s, tmp);
+    return 0;
+}
+
 /* return 0 if OK, -1 if memory error */
 /* XXX: change API so that result can be allocated */
 int mp_mul(bf_context_t *s, limb_t *result, 
@@ -1185,29 +1602,10 @@ int mp_mul(bf_context_t *s, limb_t *result,
         if (fft_mul(s, r, (limb_t *)op1, op1_size,
                     (limb_t *)op2, op2_size, FFT_MUL_R_NORESIZE))
             return -1;
-    } else
-#endif
-    {
-        mp_mul_basecase(result, op1, op1_size, op2, op2_size);
-    }
-    return 0;
-}
-
-/* tabr[] -= taba[] * b. Return the value to substract to the high
-   word. */
-static limb_t mp_sub_mul1(limb_t *tabr, const limb_t *taba, limb_t n,
-                          limb_t b)
-{
-    limb_t i, l;
-    dlimb_t t;
-    
-    l = 0;
-    for(i = 0; i < n; i++) {
-        t = tabr[i] - (dlimb_t)taba[i] * (dlimb_t)b - l;
-        tabr[i] = t;
-        l = -(t >> LIMB_BITS);
+        return 0;
     }
-    return l;
+#endif
+    return mp_mul_nofft(s, result, op1, op1_size, op2, op2_size);
 }
 
 /* WARNING: d must be >= 2^(LIMB_BITS-1) */
@@ -1411,21 +1809,6 @@ int mp_recip(bf_context_t *s, limb_t *tabr, const limb_t *taba, limb_t n)
     return -1;
 }
 
-/* return -1, 0 or 1 */
-static int mp_cmp(const limb_t *taba, const limb_t *tabb, mp_size_t n)
-{
-    mp_size_t i;
-    for(i = n - 1; i >= 0; i--) {
-        if (taba[i] != tabb[i]) {
-            if (taba[i] < tabb[i])
-                return -1;
-            else
-                return 1;
-        }
-    }
-    return 0;
-}
-
 //#define DEBUG_DIVNORM_LARGE
 //#define DEBUG_DIVNORM_LARGE2
 
@@ -1590,7 +1973,8 @@ int bf_mul(bf_t *r, const bf_t *a, const bf_t *b, limb_t prec,
                 ret = BF_ST_MEM_ERROR;
                 goto done;
             }
-            mp_mul_basecase(r->tab, a_tab, a_len, b_tab, b_len);
+            if (mp_mul_nofft(r->ctx, r->tab, a_tab, a_len, b_tab, b_len))
+                goto fail;
         }
         r->sign = r_sign;
         r->expn = a->expn + b->expn;
@@ -1811,70 +2195,1412 @@ int bf_divrem(bf_t *q, bf_t *r, const bf_t *a, const bf_t *b,
                 goto fail;
         }
     }
-
-    r->sign ^= a->sign;
-    q->sign = q_sign;
-    return bf_round(r, prec, flags);
+
+    r->sign ^= a->sign;
+    q->sign = q_sign;
+    return bf_round(r, prec, flags);
+ fail:
+    bf_set_nan(q);
+    bf_set_nan(r);
+    return BF_ST_MEM_ERROR;
+}
+
+int bf_rem(bf_t *r, const bf_t *a, const bf_t *b, limb_t prec,
+           bf_flags_t flags, int rnd_mode)
+{
+    bf_t q_s, *q = &q_s;
+    int ret;
+    
+    bf_init(r->ctx, q);
+    ret = bf_divrem(q, r, a, b, prec, flags, rnd_mode);
+    bf_delete(q);
+    return ret;
+}
+
+static inline int bf_get_limb(slimb_t *pres, const bf_t *a, int flags)
+{
+#if LIMB_BITS == 32
+    return bf_get_int32(pres, a, flags);
+#else
+    return bf_get_int64(pres, a, flags);
+#endif
+}
+
+int bf_remquo(slimb_t *pq, bf_t *r, const bf_t *a, const bf_t *b, limb_t prec,
+              bf_flags_t flags, int rnd_mode)
+{
+    bf_t q_s, *q = &q_s;
+    int ret;
+    
+    bf_init(r->ctx, q);
+    ret = bf_divrem(q, r, a, b, prec, flags, rnd_mode);
+    bf_get_limb(pq, q, BF_GET_INT_MOD);
+    bf_delete(q);
+    return ret;
+}
+
+static __maybe_unused inline limb_t mul_mod(limb_t a, limb_t b, limb_t m)
+{
+    dlimb_t t;
+    t = (dlimb_t)a * (dlimb_t)b;
+    return t % m;
+}
+
+/* return (r * 2^(n * LIMB_BITS) + tab[0..n-1]) mod m with r < m. Long
+   inputs use the normalized reciprocal of m instead of a division per
+   limb. */
+static limb_t mp_mod1(const limb_t *tab, limb_t n, limb_t m, limb_t r)
+{
+    slimb_t i;
+    dlimb_t t;
+
+    if (n >= UDIV1NORM_THRESHOLD) {
+        limb_t m1, m_inv, a;
+        int sh;
+        /* compute (x * 2^sh) mod (m * 2^sh) */
+        sh = clz(m);
+        m1 = m << sh;
+        m_inv = udiv1norm_init(m1);
+        if (sh == 0) {
+            for(i = n - 1; i >= 0; i--)
+                udiv1norm(&r, r, tab[i], m1, m_inv);
+            return r;
+        }
+        r = (r << sh) | (tab[n - 1] >> (LIMB_BITS - sh));
+        for(i = n - 1; i >= 1; i--) {
+            a = (tab[i] << sh) | (tab[i - 1] >> (LIMB_BITS - sh));
+            udiv1norm(&r, r, a, m1, m_inv);
+        }
+        udiv1norm(&r, r, tab[0] << sh, m1, m_inv);
+        return r >> sh;
+    }
+    for(i = n - 1; i >= 0; i--) {
+        t = ((dlimb_t)r << LIMB_BITS) | tab[i];
+        r = t % m;
+    }
+    return r;
+}
+
+/* Divide taba[0..na-1] by the nb limbs of tabb using tabb_inv, the nb
+   + 1 limbs of its reciprocal computed by mp_recip(), with na - nb <=
+   nb. Same contract as mp_divnorm(). The quotient is estimated from
+   the top na - nb + 1 limbs of the dividend and of the reciprocal; it
+   is at most a few units too small. */
+static int mp_divnorm_recip(bf_context_t *s, limb_t *tabq, limb_t *taba,
+                            limb_t na, const limb_t *tabb,
+                            const limb_t *tabb_inv, limb_t nb)
+{
+    limb_t nq, *tabt, i;
+
+    nq = na - nb;
+    tabt = bf_malloc(s, sizeof(limb_t) * bf_max(2 * (nq + 1), na + 1));
+    if (!tabt)
+        return -1;
+    /* Q=A*B^-1 */
+    if (mp_mul(s, tabt, tabb_inv + nb - nq, nq + 1, taba + nb - 1, nq + 1))
+        goto fail;
+    for(i = 0; i < nq + 1; i++)
+        tabq[i] = tabt[i + nq + 1];
+    /* R=A-B*Q */
+    if (mp_mul(s, tabt, tabq, nq + 1, tabb, nb))
+        goto fail;
+    mp_sub(taba, taba, tabt, nb + 1, 0);
+    bf_free(s, tabt);
+    while (taba[nb] != 0 || mp_cmp(taba, tabb, nb) >= 0) {
+        taba[nb] -= mp_sub(taba, taba, tabb, nb, 0);
+        mp_add_ui(tabq, 1, nq + 1);
+    }
+    return 0;
+ fail:
+    bf_free(s, tabt);
+    return -1;
+}
+
+/* mp_divnorm() by the normalized limbs of a BFDivisor, using what it
+   has precomputed. Long dividends are divided by blocks of at most
+   d->len quotient limbs, so that the cached reciprocal is always
+   precise enough. */
+static int mp_divnorm_pre(bf_context_t *s, limb_t *tabq, limb_t *taba,
+                          limb_t na, const BFDivisor *d)
+{
+    limb_t nb, nq, m, lo, save, r;
+    slimb_t i;
+    int ret;
+
+    nb = d->len;
+    nq = na - nb;
+    if (nb == 1 && d->inv1) {
+        r = 0;
+        for(i = na - 1; i >= 0; i--)
+            tabq[i] = udiv1norm(&r, r, taba[i], d->tab[0], d->inv1);
+        taba[0] = r;
+        return 0;
+    }
+    if (!d->inv || bf_min(nq, nb) < DIVNORM_LARGE_THRESHOLD)
+        return mp_divnorm(s, tabq, taba, na, d->tab, nb);
+    /* the top block takes the odd quotient limbs, then the remainder of
+       each block is the top of the next one */
+    m = nq - (nq - 1) / nb * nb;
+    lo = nq - m;
+    if (m < DIVNORM_LARGE_THRESHOLD)
+        ret = mp_divnorm(s, tabq + lo, taba + lo, nb + m, d->tab, nb);
+    else
+        ret = mp_divnorm_recip(s, tabq + lo, taba + lo, nb + m, d->tab,
+                               d->inv, nb);
+    while (ret == 0 && lo > 0) {
+        lo -= nb;
+        /* the top quotient limb of the block is zero and overlaps the
+           previous block */
+        save = tabq[lo + nb];
+        ret = mp_divnorm_recip(s, tabq + lo, taba + lo, 2 * nb, d->tab,
+                               d->inv, nb);
+        tabq[lo + nb] = save;
+    }
+    return ret;
+}
+
+/* Set r to the integer in tab[0..n-1] divided by 2^shift with the given
+   sign, zero being positive. */
+static int bf_set_int_limbs(bf_t *r, const limb_t *tab, limb_t n, int shift,
+                            int sign)
+{
+    if (bf_resize(r, n))
+        return -1;
+    memmove(r->tab, tab, n * sizeof(limb_t));
+    r->expn = n * LIMB_BITS - shift;
+    r->sign = sign;
+    bf_normalize_and_round(r, BF_PREC_INF, BF_RNDZ);
+    if (bf_is_zero(r))
+        r->sign = 0;
+    return 0;
+}
+
+/* tab[0..n-1] = |a| * 2^shift truncated to an integer, the integer a
+   being finite */
+static void get_int_limbs(limb_t *tab, limb_t n, const bf_t *a,
+                          slimb_t shift)
+{
+    limb_t i;
+    slimb_t pos;
+
+    if (bf_is_zero(a)) {
+        memset(tab, 0, n * sizeof(limb_t));
+        return;
+    }
+    pos = a->len * LIMB_BITS - a->expn - shift;
+    for(i = 0; i < n; i++)
+        tab[i] = get_bits(a->tab, a->len, pos + (slimb_t)(i * LIMB_BITS));
+}
+
+static int bf_divisor_divrem1(bf_t *q, bf_t *r, const bf_t *a,
+                              const BFDivisor *d)
+{
+    bf_context_t *s = d->ctx;
+    limb_t *taba, *tabq, na, nb, i;
+    slimb_t pos, d_expn;
+    int t, a_sign, q_sign;
+
+    assert(q != a && (q == NULL || q != r));
+    nb = d->len;
+    t = d->shift;
+    d_expn = nb * LIMB_BITS - t;
+    a_sign = a->sign;
+    q_sign = a->sign ^ d->sign;
+    if (bf_is_zero(a) || a->expn < d_expn) {
+        if (r && bf_set(r, a))
+            goto fail;
+        if (r && bf_is_zero(r))
+            r->sign = 0;
+        if (q)
+            bf_set_zero(q, 0);
+        return 0;
+    }
+    /* a scaled by 2^t like the divisor; the mantissa may lack its low
+       zero limbs so it is read with get_bits() */
+    na = (a->expn + t + LIMB_BITS - 1) / LIMB_BITS;
+    taba = bf_malloc(s, (na + 1) * sizeof(limb_t));
+    if (!taba)
+        goto fail;
+    pos = a->len * LIMB_BITS - a->expn - t;
+    for(i = 0; i < na; i++)
+        taba[i] = get_bits(a->tab, a->len, pos + (slimb_t)(i * LIMB_BITS));
+
+    if (!q && nb == 1 && !d->inv1) {
+        taba[0] = mp_mod1(taba, na, d->tab[0], 0);
+    } else {
+        if (q) {
+            if (bf_resize(q, na - nb + 1))
+                goto fail_free;
+            tabq = q->tab;
+        } else {
+            tabq = bf_malloc(s, (na - nb + 1) * sizeof(limb_t));
+            if (!tabq)
+                goto fail_free;
+        }
+        if (mp_divnorm_pre(s, tabq, taba, na, d)) {
+            if (!q)
+                bf_free(s, tabq);
+            goto fail_free;
+        }
+        if (q) {
+            q->expn = (na - nb + 1) * LIMB_BITS;
+            q->sign = q_sign;
+            bf_normalize_and_round(q, BF_PREC_INF, BF_RNDZ);
+        } else {
+            bf_free(s, tabq);
+        }
+    }
+    if (r && bf_set_int_limbs(r, taba, nb, t, a_sign))
+        goto fail_free;
+    bf_free(s, taba);
+    return 0;
+ fail_free:
+    bf_free(s, taba);
+ fail:
+    if (q)
+        bf_set_nan(q);
+    if (r)
+        bf_set_nan(r);
+    return BF_ST_MEM_ERROR;
+}
+
+/* Truncated division of the finite integers a and b: q = trunc(a / b)
+   and r = a - q * b, which has the sign of a. Either q or r may be NULL
+   when it is not needed, and r may be a or b. Unlike bf_divrem(), the
+   remainder comes out of the division itself instead of a - q * b, and
+   when only the remainder by a one limb divisor is wanted no quotient is
+   computed at all. A zero result is always positive. Return 0,
+   BF_ST_DIVIDE_ZERO or BF_ST_MEM_ERROR. */
+int bf_tdivrem_int(bf_t *q, bf_t *r, const bf_t *a, const bf_t *b)
+{
+    BFDivisor d_s, *d = &d_s;
+    limb_t i;
+    slimb_t pos;
+    int ret;
+
+    assert(q != b);
+    if (bf_is_zero(b)) {
+        if (q)
+            bf_set_nan(q);
+        if (r)
+            bf_set_nan(r);
+        return BF_ST_DIVIDE_ZERO;
+    }
+    /* a BFDivisor with nothing precomputed, using the limbs of b when
+       they are already normalized */
+    memset(d, 0, sizeof(*d));
+    d->ctx = a->ctx;
+    d->sign = b->sign;
+    d->len = (b->expn + LIMB_BITS - 1) / LIMB_BITS;
+    d->shift = d->len * LIMB_BITS - b->expn;
+    if (b->len == d->len) {
+        d->tab = b->tab;
+        return bf_divisor_divrem1(q, r, a, d);
+    }
+    d->tab = bf_malloc(d->ctx, d->len * sizeof(limb_t));
+    if (!d->tab) {
+        if (q)
+            bf_set_nan(q);
+        if (r)
+            bf_set_nan(r);
+        return BF_ST_MEM_ERROR;
+    }
+    pos = b->len * LIMB_BITS - b->expn - d->shift;
+    for(i = 0; i < d->len; i++)
+        d->tab[i] = get_bits(b->tab, b->len, pos + (slimb_t)(i * LIMB_BITS));
+    ret = bf_divisor_divrem1(q, r, a, d);
+    bf_free(d->ctx, d->tab);
+    return ret;
+}
+
+/* Prepare the nonzero finite integer b for repeated divisions with
+   bf_divisor_divrem(): its limbs are normalized once, and the
+   reciprocal used by the subquadratic division, or the inverse used by
+   udiv1norm() for a one limb divisor, is computed once. Return 0,
+   BF_ST_DIVIDE_ZERO or BF_ST_MEM_ERROR. */
+int bf_divisor_init(bf_context_t *s, BFDivisor *d, const bf_t *b)
+{
+    limb_t i;
+    slimb_t pos;
+
+    memset(d, 0, sizeof(*d));
+    d->ctx = s;
+    if (bf_is_zero(b))
+        return BF_ST_DIVIDE_ZERO;
+    d->sign = b->sign;
+    d->len = (b->expn + LIMB_BITS - 1) / LIMB_BITS;
+    d->shift = d->len * LIMB_BITS - b->expn;
+    d->tab = bf_malloc(s, d->len * sizeof(limb_t));
+    if (!d->tab)
+        goto fail;
+    pos = b->len * LIMB_BITS - b->expn - d->shift;
+    for(i = 0; i < d->len; i++)
+        d->tab[i] = get_bits(b->tab, b->len, pos + (slimb_t)(i * LIMB_BITS));
+    if (d->len == 1) {
+        d->inv1 = udiv1norm_init(d->tab[0]);
+    } else if (d->len >= DIVNORM_LARGE_THRESHOLD) {
+        d->inv = bf_malloc(s, (d->len + 1) * sizeof(limb_t));
+        if (!d->inv || mp_recip(s, d->inv, d->tab, d->len))
+            goto fail;
+    }
+    return 0;
+ fail:
+    bf_divisor_end(d);
+    return BF_ST_MEM_ERROR;
+}
+
+void bf_divisor_end(BFDivisor *d)
+{
+    bf_free(d->ctx, d->tab);
+    bf_free(d->ctx, d->inv);
+    d->tab = NULL;
+    d->inv = NULL;
+    d->len = 0;
+}
+
+/* Same as bf_tdivrem_int() with the divisor prepared by
+   bf_divisor_init(). r may be a. */
+int bf_divisor_divrem(bf_t *q, bf_t *r, const bf_t *a, const BFDivisor *d)
+{
+    return bf_divisor_divrem1(q, r, a, d);
+}
+
+/* GCD. Both operands are reduced in place, a >= b >= 0, until b is
+   zero. Every step is a unimodular transformation (a, b) <- L (a, b), so
+   the gcd is kept, and when the cofactors are needed the inverses are
+   accumulated in a matrix M with M (a, b) kept constant. Lehmer steps
+   apply the quotients found from the top bits of a and b at once; for
+   large operands the half-GCD computes the matrix reducing the top half
+   of the operands by recursion and applies it with a few products,
+   which makes the whole computation subquadratic. */
+
+/* 2x2 integer matrix of determinant det = +-1 */
+typedef struct {
+    bf_t m[2][2];
+    int det;
+} GCDMatrix;
+
+static int gcd_matrix_init(bf_context_t *s, GCDMatrix *M)
+{
+    int i, j;
+    for(i = 0; i < 2; i++) {
+        for(j = 0; j < 2; j++)
+            bf_init(s, &M->m[i][j]);
+    }
+    M->det = 1;
+    return bf_set_ui(&M->m[0][0], 1) | bf_set_ui(&M->m[1][1], 1);
+}
+
+static void gcd_matrix_end(GCDMatrix *M)
+{
+    int i, j;
+    for(i = 0; i < 2; i++) {
+        for(j = 0; j < 2; j++)
+            bf_delete(&M->m[i][j]);
+    }
+}
+
+/* for bf_t without inline storage */
+static void bf_swap(bf_t *a, bf_t *b)
+{
+    bf_t t;
+    t = *a;
+    *a = *b;
+    *b = t;
+}
+
+/* M <- M * [[q, 1], [1, 0]] */
+static int gcd_matrix_mul_q(GCDMatrix *M, const bf_t *q, bf_t *t)
+{
+    int i, ret = 0;
+    for(i = 0; i < 2; i++) {
+        ret |= bf_mul(t, &M->m[i][0], q, BF_PREC_INF, BF_RNDZ);
+        ret |= bf_add(t, t, &M->m[i][1], BF_PREC_INF, BF_RNDZ);
+        bf_swap(&M->m[i][1], &M->m[i][0]);
+        bf_swap(&M->m[i][0], t);
+    }
+    M->det = -M->det;
+    return ret;
+}
+
+/* M <- M * N */
+static int gcd_matrix_mul(GCDMatrix *M, const GCDMatrix *N, bf_t *t0,
+                          bf_t *t1)
+{
+    int i, ret = 0;
+    for(i = 0; i < 2; i++) {
+        ret |= bf_mul(t0, &M->m[i][0], &N->m[0][0], BF_PREC_INF, BF_RNDZ);
+        ret |= bf_mul(t1, &M->m[i][1], &N->m[1][0], BF_PREC_INF, BF_RNDZ);
+        ret |= bf_add(t0, t0, t1, BF_PREC_INF, BF_RNDZ);
+        ret |= bf_mul(t1, &M->m[i][0], &N->m[0][1], BF_PREC_INF, BF_RNDZ);
+        ret |= bf_mul(&M->m[i][0], &M->m[i][1], &N->m[1][1], BF_PREC_INF,
+                      BF_RNDZ);
+        ret |= bf_add(&M->m[i][1], &M->m[i][0], t1, BF_PREC_INF, BF_RNDZ);
+        bf_swap(&M->m[i][0], t0);
+    }
+    M->det *= N->det;
+    return ret;
+}
+
+/* Restore a >= b >= 0 after a transformation that may have overshot,
+   keeping M (a, b) */
+static void gcd_fixup(bf_t *a, bf_t *b, GCDMatrix *M)
+{
+    int i, j;
+    bf_t *v[2];
+
+    v[0] = a;
+    v[1] = b;
+    for(j = 0; j < 2; j++) {
+        if (v[j]->sign) {
+            v[j]->sign = 0;
+            if (M) {
+                for(i = 0; i < 2; i++)
+                    bf_neg(&M->m[i][j]);
+                M->det = -M->det;
+            }
+        }
+    }
+    if (bf_cmpu(a, b) < 0) {
+        bf_swap(a, b);
+        if (M) {
+            for(i = 0; i < 2; i++)
+                bf_swap(&M->m[i][0], &M->m[i][1]);
+            M->det = -M->det;
+        }
+    }
+}
+
+/* (a, b) <- (b, a mod b) */
+static int gcd_div_step(bf_t *a, bf_t *b, GCDMatrix *M)
+{
+    bf_t q, t;
+    int ret;
+
+    bf_init(a->ctx, &q);
+    bf_init(a->ctx, &t);
+    ret = bf_tdivrem_int(M ? &q : NULL, a, a, b);
+    bf_swap(a, b);
+    if (M && !ret)
+        ret = gcd_matrix_mul_q(M, &q, &t) ? BF_ST_MEM_ERROR : 0;
+    bf_delete(&q);
+    bf_delete(&t);
+    return ret;
+}
+
+/* floor(a / 2^k) modulo 2^64 */
+static uint64_t bf_get_u64_shr(const bf_t *a, slimb_t k)
+{
+    slimb_t pos;
+
+    if (bf_is_zero(a))
+        return 0;
+    pos = a->len * LIMB_BITS - a->expn + k;
+#if LIMB_BITS == 64
+    return get_bits(a->tab, a->len, pos);
+#else
+    return get_bits(a->tab, a->len, pos) |
+        ((uint64_t)get_bits(a->tab, a->len, pos + 32) << 32);
+#endif
+}
+
+/* (r0, r1) <- (x0 u - y0 v, x1 v - y1 u) for results known to be in
+   [0, 2^(n * LIMB_BITS)). r0 and r1 may be u and v. */
+static void mp_gcd_sub2(limb_t *r0, limb_t *r1, const limb_t *u,
+                        const limb_t *v, limb_t n, limb_t x0, limb_t y0,
+                        limb_t x1, limb_t y1)
+{
+    limb_t i, u0, v0, c0, c1, l0, l1;
+    dlimb_t t0, t1;
+
+    c0 = c1 = l0 = l1 = 0;
+    for(i = 0; i < n; i++) {
+        u0 = u[i];
+        v0 = v[i];
+        t0 = (dlimb_t)u0 * x0 + c0;
+        c0 = t0 >> LIMB_BITS;
+        t0 = (limb_t)t0 - (dlimb_t)v0 * y0 - l0;
+        l0 = -(limb_t)(t0 >> LIMB_BITS);
+        t1 = (dlimb_t)v0 * x1 + c1;
+        c1 = t1 >> LIMB_BITS;
+        t1 = (limb_t)t1 - (dlimb_t)u0 * y1 - l1;
+        l1 = -(limb_t)(t1 >> LIMB_BITS);
+        r0[i] = t0;
+        r1[i] = t1;
+    }
+}
+
+/* (u, v) <- (x0 u + y0 v, x1 u + y1 v) with x0, y0, x1, y1 < 2^(LIMB_BITS
+   - 2). The carries are stored in u[n] and v[n]. */
+static void mp_gcd_add2(limb_t *u, limb_t *v, limb_t n, limb_t x0,
+                        limb_t y0, limb_t x1, limb_t y1)
+{
+    limb_t i, u0, v0, c0, c1;
+    dlimb_t t0, t1;
+
+    c0 = c1 = 0;
+    for(i = 0; i < n; i++) {
+        u0 = u[i];
+        v0 = v[i];
+        t0 = (dlimb_t)u0 * x0 + (dlimb_t)v0 * y0 + c0;
+        t1 = (dlimb_t)u0 * x1 + (dlimb_t)v0 * y1 + c1;
+        u[i] = t0;
+        v[i] = t1;
+        c0 = t0 >> LIMB_BITS;
+        c1 = t1 >> LIMB_BITS;
+    }
+    u[n] = c0;
+    v[n] = c1;
+}
+
+/* number of bits of tab[0..n-1] */
+static slimb_t mp_bit_len(const limb_t *tab, limb_t n)
+{
+    while (n > 0 && tab[n - 1] == 0)
+        n--;
+    if (n == 0)
+        return 0;
+    return n * LIMB_BITS - clz(tab[n - 1]);
+}
+
+/* Lehmer steps on a >= b > 0 until b < 2^s, b is zero or the next
+   quotient needs a division: the quotients of the top LIMB_BITS - 3
+   bits of a and the same bits of b that are known to be quotients of a
+   and b (Knuth, TAOCP vol. 2, 4.5.2, algorithm L) are applied at once
+   to the limbs of a and b. The inverse transformations have
+   nonnegative entries, so their product is accumulated on limbs too and
+   multiplied into M at the end. Return the number of steps or -1 if
+   there is not enough memory. */
+static slimb_t gcd_lehmer(bf_t *a, bf_t *b, slimb_t s, GCDMatrix *M)
+{
+    bf_context_t *ctx = a->ctx;
+    GCDMatrix N;
+    bf_t t0, t1;
+    limb_t *ta, *tb, *tu[2][2], n, un, i, j;
+    slimb_t x, y, A, B, C, D, q, t, h, abits, bbits, steps;
+    int odd, ret;
+
+    n = (a->expn + LIMB_BITS - 1) / LIMB_BITS;
+    ta = bf_malloc(ctx, (2 * n + (M ? 4 * (n + 1) : 0)) * sizeof(limb_t));
+    if (!ta)
+        return -1;
+    tb = ta + n;
+    get_int_limbs(ta, n, a, 0);
+    get_int_limbs(tb, n, b, 0);
+    un = 1;
+    if (M) {
+        for(i = 0; i < 2; i++) {
+            for(j = 0; j < 2; j++) {
+                tu[i][j] = tb + n + (2 * i + j) * (n + 1);
+                tu[i][j][0] = (i == j);
+            }
+        }
+    }
+    N.det = 1;
+    steps = 0;
+    for(;;) {
+        while (n > 1 && ta[n - 1] == 0)
+            n--;
+        abits = mp_bit_len(ta, n);
+        bbits = mp_bit_len(tb, n);
+        if (bbits <= s || abits - bbits >= LIMB_BITS)
+            break;
+        h = bf_max(abits - (LIMB_BITS - 3), 0);
+        x = get_bits(ta, n, h);
+        y = get_bits(tb, n, h);
+        A = 1;
+        B = 0;
+        C = 0;
+        D = 1;
+        odd = 0;
+        for(;;) {
+            if (y + C <= 0 || y + D <= 0)
+                break;
+            q = (x + A) / (y + C);
+            if (q != (x + B) / (y + D))
+                break;
+            t = A - q * C;
+            A = C;
+            C = t;
+            t = B - q * D;
+            B = D;
+            D = t;
+            t = x - q * y;
+            x = y;
+            y = t;
+            odd ^= 1;
+        }
+        if (B == 0)
+            break;
+        /* (a, b) <- (A a + B b, C a + D b), A and D having the sign of
+           det = (-1)^odd and B and C the opposite one */
+        if (odd) {
+            mp_gcd_sub2(ta, tb, tb, ta, n, B, -A, C, -D);
+            N.det = -N.det;
+        } else {
+            mp_gcd_sub2(ta, tb, ta, tb, n, A, -B, D, -C);
+        }
+        if (M) {
+            /* U <- U * [[|D|, |B|], [|C|, |A|]] */
+            if (odd) {
+                A = -A;
+                D = -D;
+            } else {
+                B = -B;
+                C = -C;
+            }
+            for(i = 0; i < 2; i++)
+                mp_gcd_add2(tu[i][0], tu[i][1], un, D, C, B, A);
+            if ((tu[0][0][un] | tu[0][1][un] | tu[1][0][un] |
+                 tu[1][1][un]) != 0)
+                un++;
+        }
+        steps++;
+    }
+    ret = bf_set_int_limbs(a, ta, n, 0, 0) | bf_set_int_limbs(b, tb, n, 0, 0);
+    if (M && steps > 0 && ret == 0) {
+        for(i = 0; i < 2; i++) {
+            for(j = 0; j < 2; j++) {
+                bf_init(ctx, &N.m[i][j]);
+                ret |= bf_set_int_limbs(&N.m[i][j], tu[i][j], un, 0, 0);
+            }
+        }
+        bf_init(ctx, &t0);
+        bf_init(ctx, &t1);
+        if (ret == 0)
+            ret = gcd_matrix_mul(M, &N, &t0, &t1);
+        bf_delete(&t0);
+        bf_delete(&t1);
+        gcd_matrix_end(&N);
+    }
+    bf_free(ctx, ta);
+    if (ret)
+        return -1;
+    return steps;
+}
+
+/* r = floor(a / 2^k) for a >= 0 and r != a */
+static int bf_shr_int(bf_t *r, const bf_t *a, slimb_t k)
+{
+    limb_t n;
+
+    if (bf_is_zero(a) || a->expn <= k) {
+        bf_set_zero(r, 0);
+        return 0;
+    }
+    n = (a->expn - k + LIMB_BITS - 1) / LIMB_BITS;
+    if (bf_resize(r, n))
+        return -1;
+    get_int_limbs(r->tab, n, a, -k);
+    r->expn = n * LIMB_BITS;
+    r->sign = 0;
+    bf_normalize_and_round(r, BF_PREC_INF, BF_RNDZ);
+    return 0;
+}
+
+/* b < 2^s */
+static inline BOOL gcd_below(const bf_t *b, slimb_t s)
+{
+    return bf_is_zero(b) || b->expn <= s;
+}
+
+/* Reduce a >= b > 0 with b >= 2^s by at least one quotient */
+static int gcd_step(bf_t *a, bf_t *b, slimb_t s, GCDMatrix *M)
+{
+    slimb_t ret;
+
+    /* a division is cheaper than Lehmer steps when a is much longer */
+    if (a->expn - b->expn < LIMB_BITS) {
+        ret = gcd_lehmer(a, b, s, M);
+        if (ret != 0)
+            return ret < 0 ? BF_ST_MEM_ERROR : 0;
+    }
+    return gcd_div_step(a, b, M);
+}
+
+/* Half-GCD: reduce a >= b >= 0 until b < 2^s, with s >= half the bits
+   of a. Each round takes the top 2 * r bits of the operands, r being at
+   most half of what is left to remove, reduces them by r bits by
+   recursion and applies the matrix found to a and b. What the top bits
+   get wrong only shows in the last quotients and is corrected by the
+   following steps. */
+static int hgcd(bf_t *a, bf_t *b, slimb_t s, GCDMatrix *M)
+{
+    bf_context_t *ctx = a->ctx;
+    GCDMatrix N;
+    bf_t a1, b1, t0, t1;
+    slimb_t l, k, n0;
+    int ret = 0;
+
+    while (ret == 0 && !gcd_below(b, s)) {
+        l = bf_min(2 * (a->expn - s), s);
+        if (a->expn - s < HGCD_THRESHOLD || a->expn - b->expn >= LIMB_BITS) {
+            ret = gcd_step(a, b, s, M);
+            continue;
+        }
+        k = a->expn - l;
+        bf_init(ctx, &a1);
+        bf_init(ctx, &b1);
+        bf_init(ctx, &t0);
+        bf_init(ctx, &t1);
+        ret = bf_shr_int(&a1, a, k) | bf_shr_int(&b1, b, k);
+        if (ret == 0 && gcd_below(&b1, l - l / 2)) {
+            /* nothing to reduce on the top bits */
+            ret = gcd_step(a, b, s, M);
+        } else if (ret == 0) {
+            ret = gcd_matrix_init(ctx, &N);
+            if (ret == 0)
+                ret = hgcd(&a1, &b1, l - l / 2, &N);
+            if (ret == 0) {
+                /* (a, b) <- N^-1 (a, b), N^-1 = det [[n11, -n01], [-n10,
+                   n00]] */
+                n0 = a->expn;
+                ret = bf_mul(&t0, a, &N.m[1][1], BF_PREC_INF, BF_RNDZ);
+                ret |= bf_mul(&t1, b, &N.m[0][1], BF_PREC_INF, BF_RNDZ);
+                ret |= bf_sub(&t0, &t0, &t1, BF_PREC_INF, BF_RNDZ);
+                ret |= bf_mul(&t1, a, &N.m[1][0], BF_PREC_INF, BF_RNDZ);
+                ret |= bf_mul(a, b, &N.m[0][0], BF_PREC_INF, BF_RNDZ);
+                ret |= bf_sub(b, a, &t1, BF_PREC_INF, BF_RNDZ);
+                bf_swap(a, &t0);
+                if (N.det < 0) {
+                    bf_neg(a);
+                    bf_neg(b);
+                }
+                if (M)
+                    ret |= gcd_matrix_mul(M, &N, &t0, &t1);
+                if (ret == 0) {
+                    gcd_fixup(a, b, M);
+                    /* make sure of some progress */
+                    if (a->expn >= n0 && !bf_is_zero(b))
+                        ret = gcd_step(a, b, s, M);
+                }
+            }
+            gcd_matrix_end(&N);
+        }
+        bf_delete(&a1);
+        bf_delete(&b1);
+        bf_delete(&t0);
+        bf_delete(&t1);
+        if (ret)
+            ret = BF_ST_MEM_ERROR;
+    }
+    return ret;
+}
+
+/* reduce a >= b >= 0 to (gcd, 0) */
+static int gcd_reduce(bf_t *a, bf_t *b, GCDMatrix *M)
+{
+    int ret = 0;
+    while (ret == 0 && !bf_is_zero(b)) {
+        if (a->expn >= 2 * HGCD_THRESHOLD && a->expn - b->expn < LIMB_BITS)
+            ret = hgcd(a, b, a->expn / 2 + 1, M);
+        else
+            ret = gcd_step(a, b, 0, M);
+    }
+    return ret;
+}
+
+static limb_t gcd1(limb_t a, limb_t b)
+{
+    int k;
+
+    if (a == 0)
+        return b;
+    if (b == 0)
+        return a;
+    /* binary gcd */
+    k = ctz(a | b);
+    a >>= ctz(a);
+    do {
+        b >>= ctz(b);
+        if (a > b) {
+            limb_t t = a;
+            a = b;
+            b = t;
+        }
+        b -= a;
+    } while (b != 0);
+    return a << k;
+}
+
+/* g = gcd(a, b) >= 0 of the finite integers a and b. Return 0 or
+   BF_ST_MEM_ERROR. */
+int bf_gcd(bf_t *g, const bf_t *a, const bf_t *b)
+{
+    bf_t x, y;
+    int ret;
+
+    if ((bf_is_zero(a) || a->expn <= LIMB_BITS) &&
+        (bf_is_zero(b) || b->expn <= LIMB_BITS)) {
+        return bf_set_ui(g, gcd1(bf_get_u64_shr(a, 0), bf_get_u64_shr(b, 0)));
+    }
+    bf_init(g->ctx, &x);
+    bf_init(g->ctx, &y);
+    ret = bf_set(&x, a) | bf_set(&y, b);
+    x.sign = y.sign = 0;
+    if (bf_cmpu(&x, &y) < 0)
+        bf_swap(&x, &y);
+    if (ret == 0)
+        ret = gcd_reduce(&x, &y, NULL);
+    if (ret == 0)
+        ret = bf_set(g, &x);
+    bf_delete(&x);
+    bf_delete(&y);
+    if (ret) {
+        bf_set_nan(g);
+        return BF_ST_MEM_ERROR;
+    }
+    return 0;
+}
+
+/* g = gcd(a, b) = u * a + v * b with g >= 0 and the smallest
+   cofactors: |u| <= |b| / (2 g), so that u = 0 and v = sign(b) when b
+   divides a, and u = sign(a), v = 0 when b = 0. v may be NULL when only
+   u is needed. g, u and v must be distinct from each other and from a
+   and b. Return 0 or BF_ST_MEM_ERROR. */
+int bf_gcdext(bf_t *g, bf_t *u, bf_t *v, const bf_t *a, const bf_t *b)
+{
+    bf_context_t *s = g->ctx;
+    GCDMatrix M;
+    bf_t x, y, t, bg, uu, vv;
+    int ret, swap;
+
+    bf_init(s, &x);
+    bf_init(s, &y);
+    bf_init(s, &t);
+    bf_init(s, &bg);
+    bf_init(s, &uu);
+    bf_init(s, &vv);
+    ret = gcd_matrix_init(s, &M);
+    ret |= bf_set(&x, a) | bf_set(&y, b);
+    x.sign = y.sign = 0;
+    swap = bf_cmpu(&x, &y) < 0;
+    if (swap)
+        bf_swap(&x, &y);
+    if (ret == 0)
+        ret = gcd_reduce(&x, &y, &M);
+    if (ret)
+        goto done;
+    /* x = g */
+    if (bf_is_zero(b)) {
+        ret = bf_set_si(&uu, bf_is_zero(a) ? 0 : a->sign ? -1 : 1);
+    } else if (bf_is_zero(a)) {
+        ret = bf_set_si(&vv, b->sign ? -1 : 1);
+    } else {
+        /* (|a|, |b|) = M (g, 0), possibly swapped, so g = det (m11 |a|
+           - m01 |b|) */
+        ret = bf_set(&uu, swap ? &M.m[0][1] : &M.m[1][1]);
+        if ((M.det < 0) != swap)
+            bf_neg(&uu);
+        if (a->sign)
+            bf_neg(&uu);
+        /* smallest cofactors: u mod (|b| / g), rounded to nearest, then
+           v = (g - u a) / b */
+        ret |= bf_tdivrem_int(&bg, NULL, b, &x);
+        bg.sign = 0;
+        ret |= bf_tdivrem_int(NULL, &uu, &uu, &bg);
+        ret |= bf_set(&t, &uu);
+        ret |= bf_mul_2exp(&t, 1, BF_PREC_INF, BF_RNDZ);
+        if (bf_cmpu(&t, &bg) > 0) {
+            bg.sign = uu.sign;
+            ret |= bf_sub(&uu, &uu, &bg, BF_PREC_INF, BF_RNDZ);
+        }
+        if (v) {
+            ret |= bf_mul(&t, &uu, a, BF_PREC_INF, BF_RNDZ);
+            ret |= bf_sub(&t, &x, &t, BF_PREC_INF, BF_RNDZ);
+            ret |= bf_tdivrem_int(&vv, NULL, &t, b);
+        }
+    }
+    ret |= bf_set(g, &x) | bf_set(u, &uu);
+    if (bf_is_zero(u))
+        u->sign = 0;
+    if (v) {
+        ret |= bf_set(v, &vv);
+        if (bf_is_zero(v))
+            v->sign = 0;
+    }
+ done:
+    gcd_matrix_end(&M);
+    bf_delete(&x);
+    bf_delete(&y);
+    bf_delete(&t);
+    bf_delete(&bg);
+    bf_delete(&uu);
+    bf_delete(&vv);
+    if (ret) {
+        bf_set_nan(g);
+        bf_set_nan(u);
+        if (v)
+            bf_set_nan(v);
+        return BF_ST_MEM_ERROR;
+    }
+    return 0;
+}
+
+/* r = 1/a mod m with 0 <= r < m, for m > 0 and any integer a. r may be
+   a. Return 0, BF_ST_INVALID_OP if a and m are not coprime or
+   BF_ST_MEM_ERROR. */
+int bf_invmod(bf_t *r, const bf_t *a, const bf_t *m)
+{
+    bf_t g, u;
+    int ret;
+
+    bf_init(m->ctx, &g);
+    bf_init(m->ctx, &u);
+    ret = bf_gcdext(&g, &u, NULL, a, m);
+    if (ret == 0) {
+        /* g = 1 */
+        if (bf_is_zero(&g) || g.expn != 1) {
+            ret = BF_ST_INVALID_OP;
+        } else {
+            if (u.sign)
+                ret = bf_add(&u, &u, m, BF_PREC_INF, BF_RNDZ);
+            ret |= bf_set(r, &u);
+        }
+    }
+    bf_delete(&g);
+    bf_delete(&u);
+    return ret;
+}
+
+/* Modular multiplication. A BFModulus holds a positive integer m
+   prepared for many operations modulo m on residues of len limbs, all
+   below tab. When m is odd, tab = m and x is represented by x *
+   2^(len*LIMB_BITS) mod m (Montgomery form). Otherwise tab = m *
+   2^shift, the normalized divisor, x is represented by (x mod m) *
+   2^shift and products are reduced by division with the cached
+   reciprocal of tab (Barrett reduction). */
+
+/* limbs needed by the 'tmp' argument of mp_modmul() */
+#define MODMUL_TMP_SIZE(n) (6 * (n) + 2)
+
+/* return -1/m mod 2^LIMB_BITS for an odd m */
+static limb_t mont_inv1(limb_t m)
+{
+    limb_t x;
+    int i;
+
+    /* m * m = 1 mod 8, then each step doubles the correct bits */
+    x = m;
+    for(i = 0; i < 5; i++)
+        x *= 2 - m * x;
+    return -x;
+}
+
+/* r = t / 2^(n*LIMB_BITS) mod m for the 2 * n limbs of t < m *
+   2^(n*LIMB_BITS), with m odd. t is destroyed. tmp has 4 * n limbs. */
+static int mp_redc(const BFModulus *m, limb_t *r, limb_t *t, limb_t *tmp)
+{
+    limb_t n, i, c, cc;
+    dlimb_t v;
+
+    n = m->len;
+    if (!m->inv) {
+        cc = 0;
+        for(i = 0; i < n; i++) {
+            c = mp_add_mul1(t + i, m->tab, n, t[i] * m->inv1);
+            v = (dlimb_t)t[i + n] + c + cc;
+            t[i + n] = v;
+            cc = v >> LIMB_BITS;
+        }
+    } else {
+        /* q = t * (-1/m) mod 2^(n*LIMB_BITS), then t + q * m */
+        if (mp_mul(m->ctx, tmp, t, n, m->inv, n))
+            return -1;
+        if (mp_mul(m->ctx, tmp + 2 * n, tmp, n, m->tab, n))
+            return -1;
+        cc = mp_add(t, t, tmp + 2 * n, 2 * n, 0);
+    }
+    /* the result is below 2 * m */
+    if (cc || mp_cmp(t + n, m->tab, n) >= 0)
+        mp_sub(r, t + n, m->tab, n, 0);
+    else
+        memmove(r, t + n, n * sizeof(limb_t));
+    return 0;
+}
+
+/* r = the residue of the product of the residues whose product is the
+   2 * n limbs of t. t is destroyed. tmp has 4 * n limbs. */
+static int mp_modred(const BFModulus *m, limb_t *r, limb_t *t, limb_t *tmp)
+{
+    limb_t n;
+
+    if (m->mont)
+        return mp_redc(m, r, t, tmp);
+    /* t = x * y * 2^(2*shift) and the residue is x * y * 2^shift mod
+       tab */
+    n = m->len;
+    if (m->div.shift)
+        mp_shr(t, t, 2 * n, m->div.shift, 0);
+    if (mp_divnorm_pre(m->ctx, tmp, t, 2 * n, &m->div))
+        return -1;
+    memmove(r, t, n * sizeof(limb_t));
+    return 0;
+}
+
+/* r = a * b in the residues of m. r may be a or b. tmp has
+   MODMUL_TMP_SIZE(m->len) limbs. */
+static int mp_modmul(const BFModulus *m, limb_t *r, const limb_t *a,
+                     const limb_t *b, limb_t *tmp)
+{
+    limb_t n = m->len;
+    /* a == b goes to the squaring code of mp_mul() */
+    if (mp_mul(m->ctx, tmp, a, n, b, n))
+        return -1;
+    return mp_modred(m, r, tmp, tmp + 2 * n);
+}
+
+/* r = the residue of the finite integer a */
+static int mp_modset(const BFModulus *m, limb_t *r, const bf_t *a,
+                     limb_t *tmp)
+{
+    bf_t b_s, *b = &b_s;
+    limb_t n = m->len;
+    int ret;
+
+    bf_init(m->ctx, b);
+    if (bf_divisor_divrem(NULL, b, a, &m->div)) {
+        bf_delete(b);
+        return -1;
+    }
+    get_int_limbs(r, n, b, m->mont ? 0 : m->div.shift);
+    if (b->sign && !bf_is_zero(b))
+        mp_sub(r, m->tab, r, n, 0);
+    bf_delete(b);
+    if (!m->mont)
+        return 0;
+    if (mp_mul(m->ctx, tmp, r, n, m->r2, n))
+        return -1;
+    ret = mp_redc(m, r, tmp, tmp + 2 * n);
+    return ret;
+}
+
+/* r = the integer in [0, m) of the residue a */
+static int mp_modget(const BFModulus *m, bf_t *r, const limb_t *a,
+                     limb_t *tmp)
+{
+    limb_t n = m->len;
+
+    if (!m->mont)
+        return bf_set_int_limbs(r, a, n, m->div.shift, 0);
+    memcpy(tmp, a, n * sizeof(limb_t));
+    memset(tmp + n, 0, n * sizeof(limb_t));
+    if (mp_redc(m, tmp, tmp, tmp + 2 * n))
+        return -1;
+    return bf_set_int_limbs(r, tmp, n, 0, 0);
+}
+
+/* Prepare the nonzero finite integer b for modular operations modulo
+   |b|. Return 0, BF_ST_DIVIDE_ZERO or BF_ST_MEM_ERROR. */
+int bf_modulus_init(bf_context_t *s, BFModulus *m, const bf_t *b)
+{
+    bf_t t_s, *t = &t_s;
+    limb_t n, i, *acc;
+    int ret;
+
+    memset(m, 0, sizeof(*m));
+    m->ctx = s;
+    ret = bf_divisor_init(s, &m->div, b);
+    if (ret)
+        return ret;
+    n = m->len = m->div.len;
+    m->mont = get_bits(b->tab, b->len, b->len * LIMB_BITS - b->expn) & 1;
+    if (!m->mont) {
+        m->tab = m->div.tab;
+        return 0;
+    }
+    m->tab = bf_malloc(s, n * sizeof(limb_t));
+    m->r2 = bf_malloc(s, n * sizeof(limb_t));
+    if (!m->tab || !m->r2)
+        goto fail;
+    get_int_limbs(m->tab, n, b, 0);
+    m->inv1 = mont_inv1(m->tab[0]);
+    if (n >= REDC_MUL_THRESHOLD) {
+        /* -1/m mod 2^(n*LIMB_BITS), one limb at a time so that 1 + m *
+           inv has zero low limbs */
+        m->inv = bf_malloc(s, n * sizeof(limb_t));
+        acc = bf_malloc(s, n * sizeof(limb_t));
+        if (!m->inv || !acc) {
+            bf_free(s, acc);
+            goto fail;
+        }
+        memset(acc, 0, n * sizeof(limb_t));
+        acc[0] = 1;
+        for(i = 0; i < n; i++) {
+            m->inv[i] = acc[i] * m->inv1;
+            mp_add_mul1(acc + i, m->tab, n - i, m->inv[i]);
+        }
+        bf_free(s, acc);
+    }
+    /* r2 = 2^(2*n*LIMB_BITS) mod m converts to Montgomery form */
+    bf_init(s, t);
+    if (bf_set_ui(t, 1) ||
+        bf_mul_2exp(t, 2 * n * LIMB_BITS, BF_PREC_INF, BF_RNDZ) ||
+        bf_divisor_divrem(NULL, t, t, &m->div)) {
+        bf_delete(t);
+        goto fail;
+    }
+    get_int_limbs(m->r2, n, t, 0);
+    bf_delete(t);
+    return 0;
+ fail:
+    bf_modulus_end(m);
+    return BF_ST_MEM_ERROR;
+}
+
+void bf_modulus_end(BFModulus *m)
+{
+    if (m->mont) {
+        bf_free(m->ctx, m->tab);
+        bf_free(m->ctx, m->inv);
+        bf_free(m->ctx, m->r2);
+    }
+    bf_divisor_end(&m->div);
+    m->tab = NULL;
+    m->inv = NULL;
+    m->r2 = NULL;
+    m->len = 0;
+}
+
+/* window size of the exponentiation for an exponent of 'bits' bits */
+static int powmod_window(limb_t bits)
+{
+    static const uint16_t thresholds[] = { 7, 25, 81, 241, 673, 1793 };
+    int k;
+    for(k = 0; k < countof(thresholds) && bits > thresholds[k]; k++)
+        continue;
+    return k + 1;
+}
+
+/* r = a^e mod |m| for the finite integers a and e >= 0, with 0 <= r <
+   |m|. The exponent is scanned from the top by sliding windows of up to
+   powmod_window() bits, each window being an odd power read from a
+   precomputed table. Return 0 or BF_ST_MEM_ERROR. */
+int bf_powmod(bf_t *r, const bf_t *a, const bf_t *e, const BFModulus *m)
+{
+    bf_context_t *s = m->ctx;
+    limb_t n, ne, nbits, *tabe, *pow, *res, *tmp, val;
+    slimb_t i, j;
+    int k, l, is_one;
+
+    assert(!e->sign);
+    n = m->len;
+    if (bf_is_zero(e)) {
+        /* 1 mod m */
+        bf_set_ui(r, 1);
+        return bf_divisor_divrem(NULL, r, r, &m->div);
+    }
+    nbits = e->expn;
+    ne = (nbits + LIMB_BITS - 1) / LIMB_BITS;
+    k = powmod_window(nbits);
+    tabe = bf_malloc(s, sizeof(limb_t) * (ne + ((limb_t)1 << (k - 1)) * n +
+                                         n + MODMUL_TMP_SIZE(n)));
+    if (!tabe)
+        goto fail;
+    pow = tabe + ne;
+    res = pow + ((limb_t)1 << (k - 1)) * n;
+    tmp = res + n;
+    get_int_limbs(tabe, ne, e, 0);
+#define EBIT(i) ((tabe[(i) / LIMB_BITS] >> ((i) % LIMB_BITS)) & 1)
+
+    /* pow[i] = a^(2 * i + 1) */
+    if (mp_modset(m, pow, a, tmp))
+        goto fail_free;
+    if (k > 1) {
+        if (mp_modmul(m, res, pow, pow, tmp))
+            goto fail_free;
+        for(i = 1; i < ((slimb_t)1 << (k - 1)); i++) {
+            if (mp_modmul(m, pow + i * n, pow + (i - 1) * n, res, tmp))
+                goto fail_free;
+        }
+    }
+    is_one = 1;
+    i = nbits - 1;
+    while (i >= 0) {
+        if (!EBIT(i)) {
+            if (mp_modmul(m, res, res, res, tmp))
+                goto fail_free;
+            i--;
+            continue;
+        }
+        /* the longest window e[i..j] ending with a one bit */
+        j = bf_max(i - k + 1, 0);
+        while (!EBIT(j))
+            j++;
+        val = 0;
+        for(l = i; l >= j; l--)
+            val = (val << 1) | EBIT(l);
+        if (is_one) {
+            memcpy(res, pow + (val >> 1) * n, n * sizeof(limb_t));
+            is_one = 0;
+        } else {
+            for(l = i; l >= j; l--) {
+                if (mp_modmul(m, res, res, res, tmp))
+                    goto fail_free;
+            }
+            if (mp_modmul(m, res, res, pow + (val >> 1) * n, tmp))
+                goto fail_free;
+        }
+        i = j - 1;
+    }
+#undef EBIT
+    if (mp_modget(m, r, res, tmp))
+        goto fail_free;
+    bf_free(s, tabe);
+    return 0;
+ fail_free:
+    bf_free(s, tabe);
  fail:
-    bf_set_nan(q);
     bf_set_nan(r);
     return BF_ST_MEM_ERROR;
 }
 
-int bf_rem(bf_t *r, const bf_t *a, const bf_t *b, limb_t prec,
-           bf_flags_t flags, int rnd_mode)
+/* 'tmp' of the residue operations below, on the stack for small
+   moduli */
+#define MODMUL_STACK_LIMBS 16
+
+static limb_t *modmul_tmp(const BFModulus *m, limb_t *buf)
 {
-    bf_t q_s, *q = &q_s;
+    if (m->len <= MODMUL_STACK_LIMBS)
+        return buf;
+    return bf_malloc(m->ctx, MODMUL_TMP_SIZE(m->len) * sizeof(limb_t));
+}
+
+static void modmul_tmp_free(const BFModulus *m, limb_t *tmp, limb_t *buf)
+{
+    if (tmp != buf)
+        bf_free(m->ctx, tmp);
+}
+
+/* r = the residue of the finite integer a. Return 0 or
+   BF_ST_MEM_ERROR. */
+int bf_modulus_set(const BFModulus *m, limb_t *r, const bf_t *a)
+{
+    limb_t buf[MODMUL_TMP_SIZE(MODMUL_STACK_LIMBS)], *tmp;
     int ret;
-    
-    bf_init(r->ctx, q);
-    ret = bf_divrem(q, r, a, b, prec, flags, rnd_mode);
-    bf_delete(q);
+
+    tmp = modmul_tmp(m, buf);
+    if (!tmp)
+        return BF_ST_MEM_ERROR;
+    ret = mp_modset(m, r, a, tmp) ? BF_ST_MEM_ERROR : 0;
+    modmul_tmp_free(m, tmp, buf);
     return ret;
 }
 
-static inline int bf_get_limb(slimb_t *pres, const bf_t *a, int flags)
+/* r = the integer in [0, m) of the residue a. Return 0 or
+   BF_ST_MEM_ERROR. */
+int bf_modulus_get(const BFModulus *m, bf_t *r, const limb_t *a)
 {
-#if LIMB_BITS == 32
-    return bf_get_int32(pres, a, flags);
-#else
-    return bf_get_int64(pres, a, flags);
-#endif
+    limb_t buf[MODMUL_TMP_SIZE(MODMUL_STACK_LIMBS)], *tmp;
+    int ret;
+
+    tmp = modmul_tmp(m, buf);
+    if (!tmp)
+        return BF_ST_MEM_ERROR;
+    ret = mp_modget(m, r, a, tmp) ? BF_ST_MEM_ERROR : 0;
+    modmul_tmp_free(m, tmp, buf);
+    return ret;
 }
 
-int bf_remquo(slimb_t *pq, bf_t *r, const bf_t *a, const bf_t *b, limb_t prec,
-              bf_flags_t flags, int rnd_mode)
+/* r = a + b. r may be a or b. */
+void bf_modulus_add(const BFModulus *m, limb_t *r, const limb_t *a,
+                    const limb_t *b)
 {
-    bf_t q_s, *q = &q_s;
+    limb_t n = m->len;
+    if (mp_add(r, a, b, n, 0) || mp_cmp(r, m->tab, n) >= 0)
+        mp_sub(r, r, m->tab, n, 0);
+}
+
+/* r = a - b. r may be a or b. */
+void bf_modulus_sub(const BFModulus *m, limb_t *r, const limb_t *a,
+                    const limb_t *b)
+{
+    limb_t n = m->len;
+    if (mp_sub(r, a, b, n, 0))
+        mp_add(r, r, m->tab, n, 0);
+}
+
+/* r = a * b. r may be a or b. Return 0 or BF_ST_MEM_ERROR. */
+int bf_modulus_mul(const BFModulus *m, limb_t *r, const limb_t *a,
+                   const limb_t *b)
+{
+    limb_t buf[MODMUL_TMP_SIZE(MODMUL_STACK_LIMBS)], *tmp;
     int ret;
-    
-    bf_init(r->ctx, q);
-    ret = bf_divrem(q, r, a, b, prec, flags, rnd_mode);
-    bf_get_limb(pq, q, BF_GET_INT_MOD);
-    bf_delete(q);
+
+    tmp = modmul_tmp(m, buf);
+    if (!tmp)
+        return BF_ST_MEM_ERROR;
+    ret = mp_modmul(m, r, a, b, tmp) ? BF_ST_MEM_ERROR : 0;
+    modmul_tmp_free(m, tmp, buf);
     return ret;
 }
 
-static __maybe_unused inline limb_t mul_mod(limb_t a, limb_t b, limb_t m)
+/* r = 1/a. r may be a. Return 0, BF_ST_INVALID_OP if a is not
+   invertible modulo m or BF_ST_MEM_ERROR. */
+int bf_modulus_inv(const BFModulus *m, limb_t *r, const limb_t *a)
 {
-    dlimb_t t;
-    t = (dlimb_t)a * (dlimb_t)b;
-    return t % m;
+    bf_t x, mod;
+    int ret;
+
+    bf_init(m->ctx, &x);
+    bf_init(m->ctx, &mod);
+    ret = bf_modulus_get(m, &x, a);
+    if (!ret)
+        ret = bf_set_int_limbs(&mod, m->div.tab, m->len, m->div.shift, 0) ?
+            BF_ST_MEM_ERROR : 0;
+    if (!ret)
+        ret = bf_invmod(&x, &x, &mod);
+    if (!ret)
+        ret = bf_modulus_set(m, r, &x);
+    bf_delete(&x);
+    bf_delete(&mod);
+    return ret;
 }
 
-#if defined(USE_MUL_CHECK)
-static limb_t mp_mod1(const limb_t *tab, limb_t n, limb_t m, limb_t r)
+/* r[i] = 1/a[i] for the n residues a[i] of m->len limbs each, with one
+   inversion and 3 (n - 1) multiplications (Montgomery's simultaneous
+   inversion). r and a must not overlap. Return 0, BF_ST_INVALID_OP if
+   one of the a[i] is not invertible modulo m or BF_ST_MEM_ERROR. */
+int bf_modulus_inv_many(const BFModulus *m, limb_t *r, const limb_t *a,
+                        limb_t n)
 {
-    slimb_t i;
-    dlimb_t t;
+    limb_t buf[MODMUL_TMP_SIZE(MODMUL_STACK_LIMBS)], *tmp, *inv, len, i;
+    int ret;
 
-    for(i = n - 1; i >= 0; i--) {
-        t = ((dlimb_t)r << LIMB_BITS) | tab[i];
-        r = t % m;
+    len = m->len;
+    if (n == 0)
+        return 0;
+    tmp = modmul_tmp(m, buf);
+    inv = bf_malloc(m->ctx, 2 * len * sizeof(limb_t));
+    if (!tmp || !inv) {
+        ret = BF_ST_MEM_ERROR;
+        goto done;
     }
-    return r;
+    /* r[i] = a[0] ... a[i] */
+    memcpy(r, a, len * sizeof(limb_t));
+    for(i = 1; i < n; i++) {
+        if (mp_modmul(m, r + i * len, r + (i - 1) * len, a + i * len, tmp)) {
+            ret = BF_ST_MEM_ERROR;
+            goto done;
+        }
+    }
+    ret = bf_modulus_inv(m, inv, r + (n - 1) * len);
+    /* inv = 1/(a[0] ... a[i]) */
+    for(i = n - 1; ret == 0 && i > 0; i--) {
+        if (mp_modmul(m, inv + len, inv, a + i * len, tmp) ||
+            mp_modmul(m, r + i * len, inv, r + (i - 1) * len, tmp)) {
+            ret = BF_ST_MEM_ERROR;
+        }
+        memcpy(inv, inv + len, len * sizeof(limb_t));
+    }
+    if (ret == 0)
+        memcpy(r, inv, len * sizeof(limb_t));
+ done:
+    bf_free(m->ctx, inv);
+    if (tmp)
+        modmul_tmp_free(m, tmp, buf);
+    return ret;
 }
-#endif
 
 static const uint16_t sqrt_table[192] = {
 128,128,129,130,131,132,133,134,135,136,137,138,139,140,141,142,143,144,144,145,146,147,148,149,150,150,151,152,153,154,155,155,156,157,158,159,160,160,161,162,163,163,164,165,166,167,167,168,169,170,170,171,172,173,173,174,175,176,176,177,178,178,179,180,181,181,182,183,183,184,185,185,186,187,187,188,189,189,190,191,192,192,193,193,194,195,195,196,197,197,198,199,199,200,201,201,202,203,203,204,204,205,206,206,207,208,208,209,209,210,211,211,212,212,213,214,214,215,215,216,217,217,218,218,219,219,220,221,221,222,222,223,224,224,225,225,226,226,227,227,228,229,229,230,230,231,231,232,232,233,234,234,235,235,236,236,237,237,238,238,239,240,240,241,241,242,242,243,243,244,244,245,245,246,246,247,247,248,248,249,249,250,250,251,251,252,252,253,253,254,254,255,
@@ -2654,37 +4380,115 @@ static limb_t get_limb_radix(int radix)
     return radixl;
 }
 
+static void bf_radix_pow_free(BFRadixPowCache *c)
+{
+    int k;
+    for(k = 0; k < BF_RADIX_POW_CACHE_LEN; k++) {
+        bf_delete(&c->pow[k]);
+        bf_delete(&c->pow_inv[k]);
+    }
+    memset(c, 0, sizeof(*c));
+}
+
+/* Return in '*pB' radixl^(2^k) and, if 'pB_inv' is not NULL, in
+   '*pB_inv' its inverse with enough bits for a quotient of at most
+   2^k + 1 limbs. The small powers are kept in the context so that
+   they are computed once for all the conversions, the others are
+   stored in 'pow_tab'. Return != 0 if memory error. */
+static int bf_get_radix_pow(bf_context_t *s, bf_t *pow_tab,
+                            bf_t **pB, bf_t **pB_inv, int k,
+                            limb_t radixl, unsigned int radixl_bits)
+{
+    BFRadixPowCache *c = &s->radix_pow_cache;
+    bf_t *B, *B_inv, one_s, *one = &one_s;
+    limb_t n2;
+    int ret;
+
+    if (k < BF_RADIX_POW_CACHE_LEN) {
+        if (c->radixl != radixl) {
+            bf_radix_pow_free(c);
+            c->radixl = radixl;
+        }
+        B = &c->pow[k];
+        B_inv = &c->pow_inv[k];
+        if (!B->ctx) {
+            bf_init(s, B);
+            bf_init(s, B_inv);
+        }
+    } else {
+        B = &pow_tab[2 * (k - BF_RADIX_POW_CACHE_LEN)];
+        B_inv = &pow_tab[2 * (k - BF_RADIX_POW_CACHE_LEN) + 1];
+    }
+    *pB = B;
+    if (pB_inv)
+        *pB_inv = B_inv;
+    /* a memory error leaves a NaN which is recomputed next time */
+    n2 = (limb_t)1 << k;
+    if (B->len == 0) {
+        /* compute BASE^n2 */
+        ret = bf_pow_ui_ui(B, radixl, n2, BF_PREC_INF, BF_RNDZ);
+        if (ret)
+            return ret;
+    }
+    if (pB_inv && B_inv->len == 0) {
+        bf_init(s, one);
+        bf_set_ui(one, 1);
+        ret = bf_div(B_inv, one, B, (n2 + 1) * radixl_bits + 2, BF_RNDN);
+        bf_delete(one);
+        if (ret & BF_ST_MEM_ERROR)
+            return ret;
+    }
+    return 0;
+}
+
+/* number of radix limbs below which bf_integer_from_radix() uses a
+   quadratic evaluation */
+#define FROM_RADIX_BASECASE_LEN 32
+
 /* return != 0 if error */
 static int bf_integer_from_radix_rec(bf_t *r, const limb_t *tab,
-                                     limb_t n, int level, limb_t n0,
-                                     limb_t radix, bf_t *pow_tab)
+                                     limb_t n, limb_t radix, bf_t *pow_tab)
 {
     int ret;
     if (n == 1) {
         ret = bf_set_ui(r, tab[0]);
+    } else if (n <= FROM_RADIX_BASECASE_LEN) {
+        limb_t i, len, l;
+        /* Horner evaluation: no temporary numbers for the small sizes */
+        if (bf_resize(r, n))
+            return BF_ST_MEM_ERROR;
+        len = 0;
+        for(i = n; i-- > 0;) {
+            l = mp_mul1(r->tab, r->tab, len, radix, tab[i]);
+            if (l != 0)
+                r->tab[len++] = l;
+        }
+        bf_resize(r, len); /* cannot fail */
+        r->sign = 0;
+        r->expn = len * LIMB_BITS;
+        ret = bf_normalize_and_round(r, BF_PREC_INF, BF_RNDZ);
     } else {
         bf_t T_s, *T = &T_s, *B;
         limb_t n1, n2;
+        int k;
         
-        n2 = (((n0 * 2) >> (level + 1)) + 1) / 2;
+        /* n2 is the largest power of two < n so that the powers of
+           the radix only depend on the level and can be cached */
+        k = ceil_log2(n) - 1;
+        n2 = (limb_t)1 << k;
         n1 = n - n2;
-        //        printf("level=%d n0=%ld n1=%ld n2=%ld\n", level, n0, n1, n2);
-        B = &pow_tab[level];
-        if (B->len == 0) {
-            ret = bf_pow_ui_ui(B, radix, n2, BF_PREC_INF, BF_RNDZ);
-            if (ret)
-                return ret;
-        }
-        ret = bf_integer_from_radix_rec(r, tab + n2, n1, level + 1, n0,
-                                        radix, pow_tab);
+        //        printf("k=%d n1=%ld n2=%ld\n", k, n1, n2);
+        ret = bf_get_radix_pow(r->ctx, pow_tab, &B, NULL, k, radix, 0);
+        if (ret)
+            return ret;
+        ret = bf_integer_from_radix_rec(r, tab + n2, n1, radix, pow_tab);
         if (ret)
             return ret;
         ret = bf_mul(r, r, B, BF_PREC_INF, BF_RNDZ);
         if (ret)
             return ret;
         bf_init(r->ctx, T);
-        ret = bf_integer_from_radix_rec(T, tab, n2, level + 1, n0,
-                                        radix, pow_tab);
+        ret = bf_integer_from_radix_rec(T, tab, n2, radix, pow_tab);
         if (!ret)
             ret = bf_add(r, r, T, BF_PREC_INF, BF_RNDZ);
         bf_delete(T);
@@ -2703,17 +4507,23 @@ static int bf_integer_from_radix(bf_t *r, const limb_t *tab,
     bf_t *pow_tab;
     
     radixl = get_limb_radix(radix);
-    pow_tab_len = ceil_log2(n) + 2; /* XXX: check */
-    pow_tab = bf_malloc(s, sizeof(pow_tab[0]) * pow_tab_len);
-    if (!pow_tab)
-        return -1;
-    for(i = 0; i < pow_tab_len; i++)
-        bf_init(r->ctx, &pow_tab[i]);
-    ret = bf_integer_from_radix_rec(r, tab, n, 0, n, radixl, pow_tab);
-    for(i = 0; i < pow_tab_len; i++) {
-        bf_delete(&pow_tab[i]);
+    /* the powers of the levels above the cached ones */
+    pow_tab_len = (ceil_log2(n) - BF_RADIX_POW_CACHE_LEN) * 2;
+    pow_tab = NULL;
+    if (pow_tab_len > 0) {
+        pow_tab = bf_malloc(s, sizeof(pow_tab[0]) * pow_tab_len);
+        if (!pow_tab)
+            return -1;
+        for(i = 0; i < pow_tab_len; i++)
+            bf_init(r->ctx, &pow_tab[i]);
+    }
+    ret = bf_integer_from_radix_rec(r, tab, n, radixl, pow_tab);
+    if (pow_tab_len > 0) {
+        for(i = 0; i < pow_tab_len; i++) {
+            bf_delete(&pow_tab[i]);
+        }
+        bf_free(s, pow_tab);
     }
-    bf_free(s, pow_tab);
     return ret;
 }
 
@@ -2801,15 +4611,13 @@ static int bf_add_limb(bf_t *a, slimb_t *ppos, limb_t v)
     slimb_t pos;
     pos = *ppos;
     if (unlikely(pos < 0)) {
-        limb_t new_size, d, *new_tab;
+        limb_t new_size, d, old_size;
+        old_size = a->len;
         new_size = bf_max(a->len + 1, a->len * 3 / 2);
-        new_tab = bf_realloc(a->ctx, a->tab, sizeof(limb_t) * new_size);
-        if (!new_tab)
+        if (bf_resize(a, new_size))
             return -1;
-        a->tab = new_tab;
-        d = new_size - a->len;
-        memmove(a->tab + d, a->tab, a->len * sizeof(limb_t));
-        a->len = new_size;
+        d = new_size - old_size;
+        memmove(a->tab + d, a->tab, old_size * sizeof(limb_t));
         pos += d;
     }
     a->tab[pos--] = v;
@@ -3114,6 +4922,26 @@ int bf_atof(bf_t *r, const char *str, const char **pnext, int radix,
     return bf_atof_internal(r, &dummy_exp, str, pnext, radix, prec, flags, FALSE);
 }
 
+int bf_radix_limb_digits(int radix)
+{
+    return digits_per_limb_table[radix - 2];
+}
+
+int bf_set_radix_limbs(bf_t *r, const limb_t *tab, limb_t n, int radix)
+{
+    while (n > 0 && tab[n - 1] == 0)
+        n--;
+    if (n == 0) {
+        bf_set_zero(r, 0);
+        return 0;
+    }
+    if (bf_integer_from_radix(r, tab, n, radix)) {
+        bf_set_nan(r);
+        return BF_ST_MEM_ERROR;
+    }
+    return 0;
+}
+
 /* base conversion to radix */
 
 #if LIMB_BITS == 64
@@ -3337,8 +5165,7 @@ slimb_t bf_mul_log2_radix(slimb_t a1, unsigned int radix, int is_inv,
 /* 'n' is the number of output limbs */
 static void bf_integer_to_radix_rec(bf_t *pow_tab,
                                     limb_t *out, const bf_t *a, limb_t n,
-                                    int level, limb_t n0, limb_t radixl,
-                                    unsigned int radixl_bits)
+                                    limb_t radixl, unsigned int radixl_bits)
 {
     limb_t n1, n2, q_prec;
     assert(n >= 1);
@@ -3360,22 +5187,16 @@ static void bf_integer_to_radix_rec(bf_t *pow_tab,
         }
     } else {
         bf_t Q, R, *B, *B_inv;
-        int q_add;
+        int q_add, k;
         bf_init(a->ctx, &Q);
         bf_init(a->ctx, &R);
-        n2 = (((n0 * 2) >> (level + 1)) + 1) / 2;
+        /* n2 is the largest power of two < n so that the powers of
+           the radix only depend on the level and can be cached */
+        k = ceil_log2(n) - 1;
+        n2 = (limb_t)1 << k;
         n1 = n - n2;
-        B = &pow_tab[2 * level];
-        B_inv = &pow_tab[2 * level + 1];
-        if (B->len == 0) {
-            /* compute BASE^n2 */
-            bf_pow_ui_ui(B, radixl, n2, BF_PREC_INF, BF_RNDZ);
-            /* we use enough bits for the maximum possible 'n1' value,
-               i.e. n2 + 1 */
-            bf_set_ui(&R, 1);
-            bf_div(B_inv, &R, B, (n2 + 1) * radixl_bits + 2, BF_RNDN);
-        }
-        //        printf("%d: n1=% " PRId64 " n2=%" PRId64 "\n", level, n1, n2);
+        bf_get_radix_pow(a->ctx, pow_tab, &B, &B_inv, k, radixl, radixl_bits);
+        //        printf("%d: n1=% " PRId64 " n2=%" PRId64 "\n", k, n1, n2);
         q_prec = n1 * radixl_bits;
         bf_mul(&Q, a, B_inv, q_prec, BF_RNDN);
         bf_rint(&Q, BF_RNDZ);
@@ -3395,9 +5216,9 @@ static void bf_integer_to_radix_rec(bf_t *pow_tab,
         if (q_add != 0) {
             bf_add_si(&Q, &Q, q_add, BF_PREC_INF, BF_RNDZ);
         }
-        bf_integer_to_radix_rec(pow_tab, out + n2, &Q, n1, level + 1, n0,
+        bf_integer_to_radix_rec(pow_tab, out + n2, &Q, n1,
                                 radixl, radixl_bits);
-        bf_integer_to_radix_rec(pow_tab, out, &R, n2, level + 1, n0,
+        bf_integer_to_radix_rec(pow_tab, out, &R, n2,
                                 radixl, radixl_bits);
         bf_delete(&Q);
         bf_delete(&R);
@@ -3412,18 +5233,24 @@ static void bf_integer_to_radix(bf_t *r, const bf_t *a, limb_t radixl)
     int i, pow_tab_len;
     
     r_len = r->len;
-    pow_tab_len = (ceil_log2(r_len) + 2) * 2; /* XXX: check */
-    pow_tab = bf_malloc(s, sizeof(pow_tab[0]) * pow_tab_len);
-    for(i = 0; i < pow_tab_len; i++)
-        bf_init(r->ctx, &pow_tab[i]);
+    /* the powers of the levels above the cached ones */
+    pow_tab_len = (ceil_log2(r_len) - BF_RADIX_POW_CACHE_LEN) * 2;
+    pow_tab = NULL;
+    if (pow_tab_len > 0) {
+        pow_tab = bf_malloc(s, sizeof(pow_tab[0]) * pow_tab_len);
+        for(i = 0; i < pow_tab_len; i++)
+            bf_init(r->ctx, &pow_tab[i]);
+    }
 
-    bf_integer_to_radix_rec(pow_tab, r->tab, a, r_len, 0, r_len, radixl,
+    bf_integer_to_radix_rec(pow_tab, r->tab, a, r_len, radixl,
                             ceil_log2(radixl));
 
-    for(i = 0; i < pow_tab_len; i++) {
-        bf_delete(&pow_tab[i]);
+    if (pow_tab_len > 0) {
+        for(i = 0; i < pow_tab_len; i++) {
+            bf_delete(&pow_tab[i]);
+        }
+        bf_free(s, pow_tab);
     }
-    bf_free(s, pow_tab);
 }
 
 /* a must be >= 0. 'P' is the wanted number of digits in radix
@@ -3512,11 +5339,64 @@ static int bf_convert_to_radix(bf_t *r, slimb_t *pE,
     return 0;
 }
 
+#ifdef LIMB_TO_A_SSE2
+/* return the 8 decimal digits of v < 10^8 in 16 bit lanes, most
+   significant first (from Milo Yip's itoa-benchmark) */
+static inline __m128i u32_to_8digits_sse2(uint32_t v)
+{
+    __m128i abcdefgh, abcd, efgh, t;
+
+    abcdefgh = _mm_cvtsi32_si128(v);
+    /* abcd = v / 10^4, efgh = v % 10^4 */
+    abcd = _mm_srli_epi64(_mm_mul_epu32(abcdefgh,
+                                        _mm_set1_epi32(0xd1b71759)), 45);
+    efgh = _mm_sub_epi32(abcdefgh,
+                         _mm_mul_epu32(abcd, _mm_set1_epi32(10000)));
+    /* 4 * [abcd x 4, efgh x 4] */
+    t = _mm_unpacklo_epi16(abcd, efgh);
+    t = _mm_slli_epi64(t, 2);
+    t = _mm_unpacklo_epi16(t, t);
+    t = _mm_unpacklo_epi32(t, t);
+    /* divide by 10^3, 10^2, 10^1, 10^0: [a, ab, abc, abcd, e, ef, efg, efgh] */
+    t = _mm_mulhi_epu16(t, _mm_setr_epi16(8389, 5243, 13108, -32768,
+                                          8389, 5243, 13108, -32768));
+    t = _mm_mulhi_epu16(t, _mm_setr_epi16(1 << 7, 1 << 11, 1 << 13, -32768,
+                                          1 << 7, 1 << 11, 1 << 13, -32768));
+    /* remove 10 times the previous prefix: [a, b, c, d, e, f, g, h] */
+    return _mm_sub_epi16(t, _mm_slli_epi64(_mm_mullo_epi16(t, _mm_set1_epi16(10)), 16));
+}
+#endif
+
 static void limb_to_a(char *buf, limb_t n, unsigned int radix, int len)
 {
     int digit, i;
 
     if (radix == 10) {
+#ifdef LIMB_TO_A_SSE2
+        if (len == LIMB_DIGITS) {
+            __m128i d;
+#if LIMB_BITS == 64
+            limb_t hi, lo;
+            hi = n / UINT64_C(10000000000000000);
+            lo = n % UINT64_C(10000000000000000);
+            d = _mm_packus_epi16(u32_to_8digits_sse2(lo / 100000000),
+                                 u32_to_8digits_sse2(lo % 100000000));
+            _mm_storeu_si128((__m128i *)(buf + 3),
+                             _mm_add_epi8(d, _mm_set1_epi8('0')));
+            buf[2] = hi % 10 + '0';
+            hi /= 10;
+            buf[1] = hi % 10 + '0';
+            buf[0] = hi / 10 + '0';
+#else
+            d = _mm_packus_epi16(u32_to_8digits_sse2(n % 100000000),
+                                 _mm_setzero_si128());
+            _mm_storel_epi64((__m128i *)(buf + 1),
+                             _mm_add_epi8(d, _mm_set1_epi8('0')));
+            buf[0] = n / 100000000 + '0';
+#endif
+            return;
+        }
+#endif
         /* specific case with constant divisor */
         for(i = len - 1; i >= 0; i--) {
             digit = (limb_t)n % 10;
@@ -3935,6 +5815,56 @@ char *bf_ftoa(size_t *plen, const bf_t *a, int radix, limb_t prec,
     return bf_ftoa_internal(plen, a, radix, prec, flags, FALSE);
 }
 
+limb_t bf_get_radix_limbs(bf_t *r, const bf_t *a, int radix)
+{
+    bf_t a1_s, *a1 = &a1_s;
+    limb_t n, n_digits, v;
+    int digits_per_limb;
+
+    if (a->expn == BF_EXP_ZERO) {
+        bf_resize(r, 0); /* cannot fail */
+        return 1;
+    }
+    digits_per_limb = digits_per_limb_table[radix - 2];
+    /* upper bound of the number of digits */
+    n_digits = 2 + bf_mul_log2_radix(a->expn - 1, radix, TRUE, FALSE);
+    n = (n_digits + digits_per_limb - 1) / digits_per_limb;
+    if (bf_resize(r, n))
+        return 0;
+    /* the conversion ignores the sign */
+    *a1 = *a;
+    a1->sign = 0;
+    bf_integer_to_radix(r, a1, get_limb_radix(radix));
+    while (n > 1 && r->tab[n - 1] == 0)
+        n--;
+    bf_resize(r, n); /* cannot fail */
+    n_digits = (n - 1) * digits_per_limb;
+    for(v = r->tab[n - 1]; v != 0; v /= radix)
+        n_digits++;
+    return n_digits;
+}
+
+void bf_radix_limbs_to_str(char *buf, const bf_t *r, limb_t n_digits,
+                           int radix)
+{
+    limb_t i, n;
+    int digits_per_limb, l;
+
+    n = r->len;
+    if (n == 0) {
+        buf[0] = '0';
+        return;
+    }
+    digits_per_limb = digits_per_limb_table[radix - 2];
+    l = n_digits - (n - 1) * digits_per_limb;
+    limb_to_a(buf, r->tab[n - 1], radix, l);
+    buf += l;
+    for(i = n - 1; i-- > 0;) {
+        limb_to_a(buf, r->tab[i], radix, digits_per_limb);
+        buf += digits_per_limb;
+    }
+}
+
 /***************************************************************/
 /* transcendental functions */
 
@@ -4148,6 +6078,7 @@ void bf_clear_cache(bf_context_t *s)
 #endif
     bf_const_free(&s->log2_cache);
     bf_const_free(&s->pi_cache);
+    bf_radix_pow_free(&s->radix_pow_cache);
 }
 
 /* ZivFunc should compute the result 'r' with faithful rounding at
@@ -7171,6 +9102,8 @@ int bfdec_atof(bfdec_t *r, const char *str, const char **pnext,
 
 #endif /* USE_BF_DEC */
 
+#endif /* !LIBBF_AVX2_NTT */
+
 #ifdef USE_FFT_MUL
 /***************************************************************/
 /* Integer multiplication with FFT */
@@ -7193,7 +9126,7 @@ static inline void put_bits(limb_t *tab, limb_t len, slimb_t pos, limb_t val)
     }
 }
 
-#if defined(__AVX2__)
+#if defined(NTT_AVX2)
 
 typedef double NTTLimb;
 
@@ -7274,7 +9207,7 @@ static const limb_t ntt_mods_cr[NB_MODS * (NB_MODS - 1) / 2] = {
 
 #endif /* !AVX2 */
 
-#if defined(__AVX2__)
+#if defined(NTT_AVX2)
 #define NTT_TRIG_K_MAX 18
 #else
 #define NTT_TRIG_K_MAX 19
@@ -7291,7 +9224,7 @@ typedef struct BFNTTState {
     NTTLimb *ntt_trig[NB_MODS][2][NTT_TRIG_K_MAX + 1];
     /* 1/2^n mod m */
     limb_t ntt_len_inv[NB_MODS][NTT_PROOT_2EXP + 1][2];
-#if defined(__AVX2__)
+#if defined(NTT_AVX2)
     __m256d ntt_mods_cr_vec[NB_MODS * (NB_MODS - 1) / 2];
     __m256d ntt_mods_vec[NB_MODS];
     __m256d ntt_mods_inv_vec[NB_MODS];
@@ -7394,7 +9327,7 @@ static inline limb_t init_mul_mod_fast2(limb_t b, limb_t m)
     return ((dlimb_t)b << LIMB_BITS) / m;
 }
 
-#ifdef __AVX2__
+#ifdef NTT_AVX2
 
 static inline limb_t ntt_limb_to_int(NTTLimb a, limb_t m)
 {
@@ -7767,7 +9700,7 @@ static no_inline NTTLimb *get_trig(BFNTTState *s,
         return tab;
     n2 = (limb_t)1 << (k - 1);
     m = ntt_mods[m_idx];
-#ifdef __AVX2__
+#ifdef NTT_AVX2
     tab = ntt_malloc(s, sizeof(NTTLimb) * n2);
 #else
     tab = ntt_malloc(s, sizeof(NTTLimb) * n2 * 2);
@@ -7778,7 +9711,7 @@ static no_inline NTTLimb *get_trig(BFNTTState *s,
     c_mul = s->ntt_proot_pow[m_idx][inverse][k];
     c_mul_inv = s->ntt_proot_pow_inv[m_idx][inverse][k];
     for(i = 0; i < n2; i++) {
-#ifdef __AVX2__
+#ifdef NTT_AVX2
         tab[i] = int_to_ntt_limb2(c, m);
 #else
         tab[2 * i] = int_to_ntt_limb(c, m);
@@ -7794,6 +9727,12 @@ void fft_clear_cache(bf_context_t *s1)
 {
     int m_idx, inverse, k;
     BFNTTState *s = s1->ntt_state;
+#ifdef NTT_DISPATCH
+    if (bf_ntt_avx2) {
+        fft_clear_cache_avx2(s1);
+        return;
+    }
+#endif
     if (s) {
         for(m_idx = 0; m_idx < NB_MODS; m_idx++) {
             for(inverse = 0; inverse < 2; inverse++) {
@@ -7805,7 +9744,7 @@ void fft_clear_cache(bf_context_t *s1)
                 }
             }
         }
-#if defined(__AVX2__)
+#if defined(NTT_AVX2)
         bf_aligned_free(s1, s);
 #else
         bf_free(s1, s);
@@ -7817,25 +9756,34 @@ void fft_clear_cache(bf_context_t *s1)
 #define STRIP_LEN 16
 
 /* dst = buf1, src = buf2 */
+/* 'tmp' is either NULL or contains ntt_partial_tmp_size(n1, k2) limbs */
 static int ntt_fft_partial(BFNTTState *s, NTTLimb *buf1,
                            int k1, int k2, limb_t n1, limb_t n2, int inverse,
-                           limb_t m_idx)
+                           limb_t m_idx, NTTLimb *tmp)
 {
     limb_t i, j, c_mul, c0, m, m_inv, strip_len, l;
     NTTLimb *buf2, *buf3;
     
     buf2 = NULL;
-    buf3 = ntt_malloc(s, sizeof(NTTLimb) * n1);
-    if (!buf3)
-        goto fail;
+    if (tmp) {
+        buf3 = tmp;
+    } else {
+        buf3 = ntt_malloc(s, sizeof(NTTLimb) * n1);
+        if (!buf3)
+            goto fail;
+    }
     if (k2 == 0) {
         if (ntt_fft(s, buf1, buf1, buf3, k1, inverse, m_idx))
             goto fail;
     } else {
         strip_len = STRIP_LEN;
-        buf2 = ntt_malloc(s, sizeof(NTTLimb) * n1 * strip_len);
-        if (!buf2)
-            goto fail;
+        if (tmp) {
+            buf2 = tmp + n1;
+        } else {
+            buf2 = ntt_malloc(s, sizeof(NTTLimb) * n1 * strip_len);
+            if (!buf2)
+                goto fail;
+        }
         m = ntt_mods[m_idx];
         m_inv = s->ntt_mods_div[m_idx];
         c0 = s->ntt_proot_pow[m_idx][inverse][k1 + k2];
@@ -7863,50 +9811,150 @@ static int ntt_fft_partial(BFNTTState *s, NTTLimb *buf1,
                 }
             }
         }
+    }
+    if (!tmp) {
         ntt_free(s, buf2);
+        ntt_free(s, buf3);
     }
-    ntt_free(s, buf3);
     return 0;
  fail:
-    ntt_free(s, buf2);
-    ntt_free(s, buf3);
+    if (!tmp) {
+        ntt_free(s, buf2);
+        ntt_free(s, buf3);
+    }
     return -1;
 }
 
+static limb_t ntt_partial_tmp_size(limb_t n1, int k2)
+{
+    return k2 == 0 ? n1 : n1 * (STRIP_LEN + 1);
+}
 
-/* dst = buf1, src = buf2, tmp = buf3 */
-static int ntt_conv(BFNTTState *s, NTTLimb *buf1, NTTLimb *buf2,
-                    int k, int k_tot, limb_t m_idx)
+static void ntt_conv_split(int k, int *pk1, int *pk2)
 {
-    limb_t n1, n2, i;
-    int k1, k2;
-    
+    int k1;
     if (k <= NTT_TRIG_K_MAX) {
         k1 = k;
     } else {
         /* recursive split of the FFT */
         k1 = bf_min(k / 2, NTT_TRIG_K_MAX);
     }
-    k2 = k - k1;
+    *pk1 = k1;
+    *pk2 = k - k1;
+}
+
+/* number of limbs of the 'tmp' argument of ntt_conv() */
+static limb_t ntt_conv_tmp_size(int k)
+{
+    int k1, k2;
+    limb_t size;
+    ntt_conv_split(k, &k1, &k2);
+    size = ntt_partial_tmp_size((limb_t)1 << k1, k2);
+    if (k2 != 0)
+        size = bf_max(size, ntt_conv_tmp_size(k2));
+    return size;
+}
+
+
+/* dst = buf1, src = buf2. buf2 may be equal to buf1 to compute a
+   square. 'tmp' is either NULL or contains ntt_conv_tmp_size(k) limbs,
+   in which case no memory is allocated. */
+static int ntt_conv(BFNTTState *s, NTTLimb *buf1, NTTLimb *buf2,
+                    int k, int k_tot, limb_t m_idx, NTTLimb *tmp)
+{
+    limb_t n1, n2, i;
+    int k1, k2;
+    
+    ntt_conv_split(k, &k1, &k2);
     n1 = (limb_t)1 << k1;
     n2 = (limb_t)1 << k2;
     
-    if (ntt_fft_partial(s, buf1, k1, k2, n1, n2, 0, m_idx))
+    if (ntt_fft_partial(s, buf1, k1, k2, n1, n2, 0, m_idx, tmp))
         return -1;
-    if (ntt_fft_partial(s, buf2, k1, k2, n1, n2, 0, m_idx))
+    /* buf2 == buf1 for a squaring: transform only once */
+    if (buf2 != buf1 &&
+        ntt_fft_partial(s, buf2, k1, k2, n1, n2, 0, m_idx, tmp))
         return -1;
     if (k2 == 0) {
         ntt_vec_mul(s, buf1, buf2, k, k_tot, m_idx);
     } else {
         for(i = 0; i < n1; i++) {
-            ntt_conv(s, buf1 + i * n2, buf2 + i * n2, k2, k_tot, m_idx);
+            ntt_conv(s, buf1 + i * n2, buf2 + i * n2, k2, k_tot, m_idx, tmp);
         }
     }
-    if (ntt_fft_partial(s, buf1, k1, k2, n1, n2, 1, m_idx))
+    if (ntt_fft_partial(s, buf1, k1, k2, n1, n2, 1, m_idx, tmp))
         return -1;
     return 0;
 }
 
+/* compute the trig tables which may be used by a NTT of size 2^k so
+   that ntt_conv() does not modify 's' */
+static int ntt_trig_init(BFNTTState *s, int k, int m_idx)
+{
+    int inverse, l;
+    k = bf_min(k, NTT_TRIG_K_MAX);
+    for(inverse = 0; inverse < 2; inverse++) {
+        for(l = 1; l <= k; l++) {
+            if (!get_trig(s, l, inverse, m_idx))
+                return -1;
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    BFNTTState *s;
+    NTTLimb *buf1;
+    NTTLimb *buf2; /* equal to buf1 for a squaring */
+    NTTLimb *tmp; /* ntt_conv_tmp_size() limbs per modulus */
+    limb_t tmp_size;
+    slimb_t fft_len;
+    int fft_len_log2;
+    int nb_mods;
+    int ret[NB_MODS];
+} NTTConvTasks;
+
+static void ntt_conv_task(void *arg, int j)
+{
+    NTTConvTasks *t = arg;
+    t->ret[j] = ntt_conv(t->s, t->buf1 + t->fft_len * j,
+                         t->buf2 + t->fft_len * j,
+                         t->fft_len_log2, t->fft_len_log2,
+                         j + NB_MODS - t->nb_mods, t->tmp + t->tmp_size * j);
+}
+
+/* convolutions of all the moduli with the tasks run through the
+   parallel hook of the context. buf1 and buf2 contain all the
+   moduli. */
+static int ntt_conv_parallel(BFNTTState *s, NTTLimb *buf1, NTTLimb *buf2,
+                             int fft_len_log2, int nb_mods)
+{
+    const bf_parallel_t *par = s->ctx->parallel;
+    NTTConvTasks t;
+    int j, ret;
+    
+    for(j = 0; j < nb_mods; j++) {
+        if (ntt_trig_init(s, fft_len_log2, j + NB_MODS - nb_mods))
+            return -1;
+    }
+    t.s = s;
+    t.buf1 = buf1;
+    t.buf2 = buf2;
+    t.fft_len = (slimb_t)1 << fft_len_log2;
+    t.fft_len_log2 = fft_len_log2;
+    t.nb_mods = nb_mods;
+    t.tmp_size = ntt_conv_tmp_size(fft_len_log2);
+    t.tmp = ntt_malloc(s, sizeof(NTTLimb) * t.tmp_size * nb_mods);
+    if (!t.tmp)
+        return -1;
+    par->run(par->opaque, ntt_conv_task, &t, nb_mods);
+    ntt_free(s, t.tmp);
+    ret = 0;
+    for(j = 0; j < nb_mods; j++)
+        ret |= t.ret[j];
+    return ret;
+}
+
 
 static no_inline void limb_to_ntt(BFNTTState *s,
                                   NTTLimb *tabr, limb_t fft_len,
@@ -7968,7 +10016,7 @@ static no_inline void limb_to_ntt(BFNTTState *s,
     }
 }
 
-#if defined(__AVX2__)
+#if defined(NTT_AVX2)
 
 #define VEC_LEN 4
 
@@ -8189,7 +10237,7 @@ static int ntt_static_init(bf_context_t *s1)
 
     if (s1->ntt_state)
         return 0;
-#if defined(__AVX2__)
+#if defined(NTT_AVX2)
     s = bf_aligned_malloc(s1, sizeof(*s), 64);
 #else
     s = bf_malloc(s1, sizeof(*s));
@@ -8204,7 +10252,7 @@ static int ntt_static_init(bf_context_t *s1)
         m = ntt_mods[j];
         m_inv = init_mul_mod_fast(m);
         s->ntt_mods_div[j] = m_inv;
-#if defined(__AVX2__)
+#if defined(NTT_AVX2)
         s->ntt_mods_vec[j] = _mm256_set1_pd(m);
         s->ntt_mods_inv_vec[j] = _mm256_set1_pd(1.0 / (double)m);
 #endif
@@ -8230,7 +10278,7 @@ static int ntt_static_init(bf_context_t *s1)
     l = 0;
     for(j = 0; j < NB_MODS - 1; j++) {
         for(k = j + 1; k < NB_MODS; k++) {
-#if defined(__AVX2__)
+#if defined(NTT_AVX2)
             s->ntt_mods_cr_vec[l] = _mm256_set1_pd(int_to_ntt_limb2(ntt_mods_cr[l],
                                                                     ntt_mods[k]));
 #else
@@ -8249,6 +10297,10 @@ int bf_get_fft_size(int *pdpl, int *pnb_mods, limb_t len)
     int int_bits, nb_mods_found;
     limb_t cost, min_cost;
     
+#ifdef NTT_DISPATCH
+    if (bf_ntt_avx2)
+        return bf_get_fft_size_avx2(pdpl, pnb_mods, len);
+#endif
     min_cost = -1;
     dpl_found = 0;
     nb_mods_found = 4;
@@ -8298,13 +10350,17 @@ static no_inline int fft_mul(bf_context_t *s1,
                              limb_t *b_tab, limb_t b_len, int mul_flags)
 {
     BFNTTState *s;
-    int dpl, fft_len_log2, j, nb_mods, reduced_mem;
+    int dpl, fft_len_log2, j, nb_mods, reduced_mem, is_sqr, parallel;
     slimb_t len, fft_len;
     NTTLimb *buf1, *buf2, *ptr;
 #if defined(USE_MUL_CHECK)
     limb_t ha, hb, hr, h_ref;
 #endif
     
+#ifdef NTT_DISPATCH
+    if (bf_ntt_avx2)
+        return fft_mul_avx2(s1, res, a_tab, a_len, b_tab, b_len, mul_flags);
+#endif
     if (ntt_static_init(s1))
         return -1;
     s = s1->ntt_state;
@@ -8331,17 +10387,38 @@ static no_inline int fft_mul(bf_context_t *s1,
         a_len = b_len;
         b_len = tmp_len;
     }
+    is_sqr = (a_tab == b_tab && a_len == b_len);
+    buf2 = NULL;
     buf1 = ntt_malloc(s, sizeof(NTTLimb) * fft_len * nb_mods);
     if (!buf1)
         return -1;
     limb_to_ntt(s, buf1, fft_len, a_tab, a_len, dpl,
                 NB_MODS - nb_mods, nb_mods);
     if ((mul_flags & (FFT_MUL_R_OVERLAP_A | FFT_MUL_R_OVERLAP_B)) == 
-        FFT_MUL_R_OVERLAP_A) {
+        FFT_MUL_R_OVERLAP_A || is_sqr) {
         if (!(mul_flags & FFT_MUL_R_NORESIZE))
             bf_resize(res, 0);
     }
-    reduced_mem = (fft_len_log2 >= 14);
+    /* the moduli are handled concurrently if the context allows it,
+       which requires all of them in memory */
+    parallel = (s1->parallel && nb_mods > 1 &&
+                s1->parallel->use(s1->parallel->opaque, len));
+    reduced_mem = (fft_len_log2 >= 14) && !parallel;
+    if (is_sqr) {
+        /* a single transform per modulus */
+        if (parallel) {
+            if (ntt_conv_parallel(s, buf1, buf1, fft_len_log2, nb_mods))
+                goto fail;
+            goto done;
+        }
+        for(j = 0; j < nb_mods; j++) {
+            ptr = buf1 + fft_len * j;
+            if (ntt_conv(s, ptr, ptr, fft_len_log2, fft_len_log2,
+                         j + NB_MODS - nb_mods, NULL))
+                goto fail;
+        }
+        goto done;
+    }
     if (!reduced_mem) {
         buf2 = ntt_malloc(s, sizeof(NTTLimb) * fft_len * nb_mods);
         if (!buf2)
@@ -8355,22 +10432,29 @@ static no_inline int fft_mul(bf_context_t *s1,
         if (!buf2)
             goto fail;
     }
-    for(j = 0; j < nb_mods; j++) {
-        if (reduced_mem) {
-            limb_to_ntt(s, buf2, fft_len, b_tab, b_len, dpl,
-                        NB_MODS - nb_mods + j, 1);
-            ptr = buf2;
-        } else {
-            ptr = buf2 + fft_len * j;
-        }
-        if (ntt_conv(s, buf1 + fft_len * j, ptr,
-                     fft_len_log2, fft_len_log2, j + NB_MODS - nb_mods))
+    if (parallel) {
+        if (ntt_conv_parallel(s, buf1, buf2, fft_len_log2, nb_mods))
             goto fail;
+    } else {
+        for(j = 0; j < nb_mods; j++) {
+            if (reduced_mem) {
+                limb_to_ntt(s, buf2, fft_len, b_tab, b_len, dpl,
+                            NB_MODS - nb_mods + j, 1);
+                ptr = buf2;
+            } else {
+                ptr = buf2 + fft_len * j;
+            }
+            if (ntt_conv(s, buf1 + fft_len * j, ptr,
+                         fft_len_log2, fft_len_log2, j + NB_MODS - nb_mods,
+                         NULL))
+                goto fail;
+        }
     }
     if (!(mul_flags & FFT_MUL_R_NORESIZE))
         bf_resize(res, 0); /* in case res == b and reduced mem */
     ntt_free(s, buf2);
     buf2 = NULL;
+ done:
     if (!(mul_flags & FFT_MUL_R_NORESIZE)) {
         if (bf_resize(res, len))
             goto fail;
@@ -8394,6 +10478,42 @@ static no_inline int fft_mul(bf_context_t *s1,
     return -1;
 }
 
+#if defined(LIBBF_AVX2_NTT)
+
+int fft_mul_avx2(bf_context_t *s, bf_t *res, limb_t *a_tab, limb_t a_len,
+                 limb_t *b_tab, limb_t b_len, int mul_flags)
+{
+    return fft_mul(s, res, a_tab, a_len, b_tab, b_len, mul_flags);
+}
+
+void fft_clear_cache_avx2(bf_context_t *s)
+{
+    fft_clear_cache(s);
+}
+
+#elif defined(NTT_DISPATCH)
+
+int bf_ntt_select(void)
+{
+    __builtin_cpu_init();
+    bf_ntt_avx2 = __builtin_cpu_supports("avx2") &&
+        __builtin_cpu_supports("fma");
+    return bf_ntt_avx2;
+}
+
+#else
+
+int bf_ntt_select(void)
+{
+#if defined(NTT_AVX2)
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+#endif
+
 #else /* USE_FFT_MUL */
 
 int bf_get_fft_size(int *pdpl, int *pnb_mods, limb_t len)
@@ -8401,4 +10521,9 @@ int bf_get_fft_size(int *pdpl, int *pnb_mods, limb_t len)
     return 0;
 }
 
+int bf_ntt_select(void)
+{
+    return FALSE;
+}
+
 #endif /* !USE_FFT_MUL */
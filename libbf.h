@@ -91,6 +91,7 @@ typedef uint64_t dlimb_t;
 typedef struct {
     struct bf_context_t *ctx;
     int sign;
+    int has_inline; /* TRUE if the bf_t is the 'b' of a bf_inline_t */
     slimb_t expn;
     limb_t len;
     limb_t *tab;
@@ -100,11 +101,30 @@ typedef struct {
     /* must be kept identical to bf_t */
     struct bf_context_t *ctx;
     int sign;
+    int has_inline;
     slimb_t expn;
     limb_t len;
     limb_t *tab;
 } bfdec_t;
 
+/* A bf_t followed by room for a small mantissa. After
+   bf_init_inline(), the mantissa is kept in 'inline_tab' instead of
+   heap memory as long as it fits in BF_INLINE_LIMBS limbs. Once it
+   has grown past that it stays on the heap. The room is sized so that
+   128 bit integers fit together with the extra low limbs that the
+   add, sub and mul kernels use before renormalizing. */
+#define BF_INLINE_LIMBS (256 / LIMB_BITS)
+
+typedef struct {
+    bf_t b;
+    limb_t inline_tab[BF_INLINE_LIMBS];
+} bf_inline_t;
+
+static inline int bf_tab_is_inline(const bf_t *r)
+{
+    return r->has_inline && r->tab == ((const bf_inline_t *)r)->inline_tab;
+}
+
 typedef enum {
     BF_RNDN, /* round to nearest, ties to even */
     BF_RNDZ, /* round to zero */
@@ -141,12 +161,37 @@ typedef struct {
     limb_t prec;
 } BFConstCache;
 
+/* number of powers radix^(2^k) kept by the integer radix conversions */
+#define BF_RADIX_POW_CACHE_LEN 12
+
+typedef struct {
+    limb_t radixl; /* radix of the cached powers, 0 if none */
+    bf_t pow[BF_RADIX_POW_CACHE_LEN]; /* radixl^(2^k) */
+    bf_t pow_inv[BF_RADIX_POW_CACHE_LEN]; /* approximation of 1/pow[k] */
+} BFRadixPowCache;
+
+typedef void bf_parallel_task_func_t(void *arg, int idx);
+
+/* Optional parallel execution of the NTT multiplication. The tasks
+   never allocate memory nor use the context. */
+typedef struct {
+    /* return TRUE if a product of 'len' limbs should use run() */
+    int (*use)(void *opaque, limb_t len);
+    /* call func(arg, i) for 0 <= i < n, possibly concurrently, and
+       return when all the calls are done */
+    void (*run)(void *opaque, bf_parallel_task_func_t *func, void *arg,
+                int n);
+    void *opaque;
+} bf_parallel_t;
+
 typedef struct bf_context_t {
     void *realloc_opaque;
     bf_realloc_func_t *realloc_func;
     BFConstCache log2_cache;
     BFConstCache pi_cache;
+    BFRadixPowCache radix_pow_cache;
     struct BFNTTState *ntt_state;
+    const bf_parallel_t *parallel; /* NULL if not used */
 } bf_context_t;
 
 static inline int bf_get_exp_bits(bf_flags_t flags)
@@ -196,6 +241,10 @@ void bf_context_init(bf_context_t *s, bf_realloc_func_t *realloc_func,
 void bf_context_end(bf_context_t *s);
 /* free memory allocated for the bf cache data */
 void bf_clear_cache(bf_context_t *s);
+/* Select the NTT implementation (scalar or AVX2) matching the running
+   CPU. It must be called before the first multiplication of any
+   context. Return TRUE if the AVX2 NTT is used. */
+int bf_ntt_select(void);
 
 static inline void *bf_realloc(bf_context_t *s, void *ptr, size_t size)
 {
@@ -216,12 +265,13 @@ static inline void bf_free(bf_context_t *s, void *ptr)
 }
 
 void bf_init(bf_context_t *s, bf_t *r);
+void bf_init_inline(bf_context_t *s, bf_inline_t *r);
 
 static inline void bf_delete(bf_t *r)
 {
     bf_context_t *s = r->ctx;
     /* we accept to delete a zeroed bf_t structure */
-    if (s && r->tab) {
+    if (s && r->tab && !bf_tab_is_inline(r)) {
         bf_realloc(s, r->tab, 0);
     }
 }
@@ -295,6 +345,54 @@ int bf_rem(bf_t *r, const bf_t *a, const bf_t *b, limb_t prec,
            bf_flags_t flags, int rnd_mode);
 int bf_remquo(slimb_t *pq, bf_t *r, const bf_t *a, const bf_t *b, limb_t prec,
               bf_flags_t flags, int rnd_mode);
+/* truncated division of integers, q or r may be NULL */
+int bf_tdivrem_int(bf_t *q, bf_t *r, const bf_t *a, const bf_t *b);
+
+/* an integer divisor prepared for repeated divisions */
+typedef struct {
+    bf_context_t *ctx;
+    int sign;
+    int shift; /* |divisor| = tab / 2^shift */
+    limb_t len; /* limbs in tab, the top one is normalized */
+    limb_t *tab;
+    limb_t *inv; /* len + 1 limbs of reciprocal, or NULL */
+    limb_t inv1; /* udiv1norm() inverse when len = 1 */
+} BFDivisor;
+
+int bf_divisor_init(bf_context_t *s, BFDivisor *d, const bf_t *b);
+void bf_divisor_end(BFDivisor *d);
+int bf_divisor_divrem(bf_t *q, bf_t *r, const bf_t *a, const BFDivisor *d);
+
+/* a positive integer modulus prepared for modular multiplication */
+typedef struct {
+    bf_context_t *ctx;
+    limb_t len; /* limbs of the residues */
+    int mont; /* odd modulus: residues are in Montgomery form */
+    limb_t *tab; /* the len limbs all residues are below */
+    limb_t inv1; /* Montgomery: -1/modulus mod 2^LIMB_BITS */
+    limb_t *inv; /* large Montgomery: -1/modulus mod 2^(len*LIMB_BITS) */
+    limb_t *r2; /* Montgomery: 2^(2*len*LIMB_BITS) mod modulus */
+    BFDivisor div; /* the modulus prepared for division */
+} BFModulus;
+
+int bf_modulus_init(bf_context_t *s, BFModulus *m, const bf_t *b);
+void bf_modulus_end(BFModulus *m);
+int bf_powmod(bf_t *r, const bf_t *a, const bf_t *e, const BFModulus *m);
+/* operations on residues, arrays of m->len limbs */
+int bf_modulus_set(const BFModulus *m, limb_t *r, const bf_t *a);
+int bf_modulus_get(const BFModulus *m, bf_t *r, const limb_t *a);
+void bf_modulus_add(const BFModulus *m, limb_t *r, const limb_t *a,
+                    const limb_t *b);
+void bf_modulus_sub(const BFModulus *m, limb_t *r, const limb_t *a,
+                    const limb_t *b);
+int bf_modulus_mul(const BFModulus *m, limb_t *r, const limb_t *a,
+                   const limb_t *b);
+int bf_modulus_inv(const BFModulus *m, limb_t *r, const limb_t *a);
+int bf_modulus_inv_many(const BFModulus *m, limb_t *r, const limb_t *a,
+                        limb_t n);
+int bf_gcd(bf_t *g, const bf_t *a, const bf_t *b);
+int bf_gcdext(bf_t *g, bf_t *u, bf_t *v, const bf_t *a, const bf_t *b);
+int bf_invmod(bf_t *r, const bf_t *a, const bf_t *m);
 /* round to integer with infinite precision */
 int bf_rint(bf_t *r, int rnd_mode);
 int bf_round(bf_t *r, limb_t prec, bf_flags_t flags);
@@ -324,6 +422,12 @@ int bf_atof2(bf_t *r, slimb_t *pexponent,
              limb_t prec, bf_flags_t flags);
 int bf_mul_pow_radix(bf_t *r, const bf_t *T, limb_t radix,
                      slimb_t expn, limb_t prec, bf_flags_t flags);
+/* set 'r' to the non negative integer whose 'n' limbs in radix
+   'radix' are in 'tab', least significant first. Each limb holds
+   bf_radix_limb_digits(radix) digits (LIMB_DIGITS for radix 10).
+   'radix' must not be a power of two. Return 0 or BF_ST_MEM_ERROR. */
+int bf_set_radix_limbs(bf_t *r, const limb_t *tab, limb_t n, int radix);
+int bf_radix_limb_digits(int radix);
 
 
 /* Conversion of floating point number to string. Return a null
@@ -372,6 +476,16 @@ int bf_mul_pow_radix(bf_t *r, const bf_t *T, limb_t radix,
 char *bf_ftoa(size_t *plen, const bf_t *a, int radix, limb_t prec,
               bf_flags_t flags);
 
+/* Conversion of an integer to a string in a caller provided buffer.
+   bf_get_radix_limbs() stores the digits of |a| in radix 'radix' as
+   limbs in 'r' (see bf_set_radix_limbs()) and returns the exact number
+   of digits, or 0 if memory error. bf_radix_limbs_to_str() then
+   writes these digits to 'buf' without a null terminator. 'radix'
+   must not be a power of two. */
+limb_t bf_get_radix_limbs(bf_t *r, const bf_t *a, int radix);
+void bf_radix_limbs_to_str(char *buf, const bf_t *r, limb_t n_digits,
+                           int radix);
+
 /* modulo 2^n instead of saturation. NaN and infinity return 0 */
 #define BF_GET_INT_MOD (1 << 0) 
 int bf_get_int32(int *pres, const bf_t *a, int flags);
@@ -0,0 +1,32 @@
+/*
+ * AVX2 build of the libbf NTT multiplication.
+ *
+ * libbf.c is compiled a second time with the AVX2 and FMA instruction
+ * sets enabled and only its NTT code kept. bf_ntt_select() switches
+ * libbf to these entry points when the CPU supports them, so the
+ * module gets the vector NTT without being built for a specific host.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    !defined(__AVX2__)
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2,fma"))), \
+                              apply_to = function)
+#else
+#pragma GCC target("avx2,fma")
+#endif
+
+#define LIBBF_AVX2_NTT
+#define bf_get_fft_size bf_get_fft_size_avx2
+#include "libbf.c"
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+#else
+
+/* libbf.c already uses the AVX2 NTT or the CPU has none */
+typedef int libbf_avx2_unused;
+
+#endif
@@ -0,0 +1,103 @@
+/* Decimal limb to ASCII conversion benchmark for libbf.
+ *
+ * Compares limb_to_a(), which converts full base 10^19 limbs with
+ * SSE2 when available, against the digit by digit division loop it
+ * replaced, and checks that both give the same characters.
+ *
+ * Build and run from this directory:
+ *
+ *   cc -O2 -I.. -o limb_to_a limb_to_a.c ../libbf_avx2.c ../cutils.c -lm
+ *   ./limb_to_a
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "../libbf.c"
+
+/* libbf.c poisons the libc allocator */
+#undef malloc
+#undef free
+#undef realloc
+
+#define N_LIMBS 4096
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* the previous radix 10 conversion */
+static void limb_to_a_loop(char *buf, limb_t n, int len)
+{
+    int i;
+    for(i = len - 1; i >= 0; i--) {
+        buf[i] = (limb_t)n % 10 + '0';
+        n = (limb_t)n / 10;
+    }
+}
+
+/* best time of a few trials in nanoseconds per limb */
+static double time_conv(int use_loop, const limb_t *tab, char *out)
+{
+    double t0, t, best;
+    long reps, k;
+    int trial, i;
+
+    reps = 16;
+    best = 1e30;
+    for(trial = 0; trial < 7; trial++) {
+        t0 = now();
+        for(k = 0; k < reps; k++) {
+            if (use_loop) {
+                for(i = 0; i < N_LIMBS; i++)
+                    limb_to_a_loop(out + i * LIMB_DIGITS, tab[i], LIMB_DIGITS);
+            } else {
+                for(i = 0; i < N_LIMBS; i++)
+                    limb_to_a(out + i * LIMB_DIGITS, tab[i], 10, LIMB_DIGITS);
+            }
+        }
+        t = (now() - t0) / ((double)reps * N_LIMBS);
+        if (t < best)
+            best = t;
+    }
+    return best * 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    static limb_t tab[N_LIMBS];
+    static char out1[N_LIMBS * LIMB_DIGITS + 16];
+    static char out2[N_LIMBS * LIMB_DIGITS + 16];
+    double t_loop, t_new;
+    int i;
+
+    for(i = 0; i < N_LIMBS; i++) {
+        tab[i] = ((limb_t)rand() << 40) ^ ((limb_t)rand() << 20) ^ rand();
+        tab[i] %= RADIXL_10;
+    }
+    /* edge values */
+    tab[0] = 0;
+    tab[1] = RADIXL_10 - 1;
+    tab[2] = 1;
+    for(i = 0; i < N_LIMBS; i++) {
+        limb_to_a_loop(out1 + i * LIMB_DIGITS, tab[i], LIMB_DIGITS);
+        limb_to_a(out2 + i * LIMB_DIGITS, tab[i], 10, LIMB_DIGITS);
+    }
+    if (memcmp(out1, out2, N_LIMBS * LIMB_DIGITS) != 0) {
+        printf("limb_to_a mismatch\n");
+        return 1;
+    }
+#ifdef LIMB_TO_A_SSE2
+    printf("limb_to_a: SSE2\n");
+#else
+    printf("limb_to_a: division loop\n");
+#endif
+    t_loop = time_conv(1, tab, out1);
+    t_new = time_conv(0, tab, out2);
+    printf("  division loop %8.2f ns/limb\n", t_loop);
+    printf("  limb_to_a     %8.2f ns/limb  %.2fx\n", t_new, t_loop / t_new);
+    return 0;
+}
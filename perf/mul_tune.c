@@ -0,0 +1,163 @@
+/* Multiplication threshold tuning for libbf.
+ *
+ * Times a single level of each multiplication algorithm against the
+ * previous tier so that the crossover points can be read off and copied
+ * into the *_THRESHOLD defines at the top of libbf.c.
+ *
+ * Build and run from this directory:
+ *
+ *   cc -O2 -I.. -o mul_tune mul_tune.c ../libbf_avx2.c ../cutils.c -lm
+ *   ./mul_tune        # scalar NTT
+ *   ./mul_tune avx2   # AVX2 NTT when the CPU supports it
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "../libbf.c"
+
+/* libbf.c poisons the libc allocator */
+#undef malloc
+#undef free
+#undef realloc
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void *tune_realloc(void *opaque, void *ptr, size_t size)
+{
+    (void)opaque;
+    return realloc(ptr, size);
+}
+
+typedef enum {
+    ALGO_BASECASE,
+    ALGO_KARATSUBA,
+    ALGO_TOOM3,
+    ALGO_FFT,
+} algo_t;
+
+static bf_context_t ctx;
+static limb_t *tmp;
+
+/* one top level step of 'algo', the recursion uses the compiled
+   thresholds */
+static void mul_once(algo_t algo, limb_t *r, const limb_t *a, const limb_t *b,
+                     limb_t n)
+{
+    bf_t r_s;
+    switch(algo) {
+    case ALGO_BASECASE:
+        if (a == b)
+            mp_sqr_basecase(r, a, n);
+        else
+            mp_mul_basecase(r, a, n, b, n);
+        break;
+    case ALGO_KARATSUBA:
+        mp_mul_karatsuba(r, a, n, b, n, (n + 1) / 2, tmp);
+        break;
+    case ALGO_TOOM3:
+        mp_mul_toom3(r, a, n, b, n, (n + 2) / 3, tmp);
+        break;
+    case ALGO_FFT:
+        r_s.tab = r;
+        fft_mul(&ctx, &r_s, (limb_t *)a, n, (limb_t *)b, n,
+                FFT_MUL_R_NORESIZE);
+        break;
+    }
+}
+
+/* best time of a few trials in microseconds */
+static double time_mul(algo_t algo, limb_t n, int sqr)
+{
+    limb_t *a, *b, *r, i;
+    double t0, t, best;
+    long reps, k;
+    int trial;
+
+    a = malloc(n * sizeof(limb_t));
+    b = malloc(n * sizeof(limb_t));
+    r = malloc(2 * n * sizeof(limb_t));
+    for(i = 0; i < n; i++) {
+        a[i] = ((limb_t)rand() << 40) ^ ((limb_t)rand() << 20) ^ rand();
+        b[i] = ((limb_t)rand() << 40) ^ ((limb_t)rand() << 20) ^ rand();
+    }
+    if (sqr) {
+        free(b);
+        b = a;
+    }
+    reps = 1;
+    for(;;) {
+        t0 = now();
+        for(k = 0; k < reps; k++)
+            mul_once(algo, r, a, b, n);
+        if (now() - t0 > 0.002)
+            break;
+        reps *= 2;
+    }
+    best = 1e30;
+    for(trial = 0; trial < 7; trial++) {
+        t0 = now();
+        for(k = 0; k < reps; k++)
+            mul_once(algo, r, a, b, n);
+        t = (now() - t0) / reps;
+        if (t < best)
+            best = t;
+    }
+    free(a);
+    if (!sqr)
+        free(b);
+    free(r);
+    return best * 1e6;
+}
+
+/* print the timings of 'lo' and 'hi' for each size and return the
+   first size from which 'hi' is consistently faster */
+static limb_t crossover(const char *name, algo_t lo, algo_t hi,
+                        limb_t n_min, limb_t n_max, limb_t step, int sqr)
+{
+    limb_t n, found;
+    double t_lo, t_hi;
+
+    printf("%s%s\n", name, sqr ? " (squaring)" : "");
+    found = 0;
+    for(n = n_min; n <= n_max; n += step) {
+        t_lo = time_mul(lo, n, sqr);
+        t_hi = time_mul(hi, n, sqr);
+        printf("  n=%4u %10.3f us %10.3f us  %.2f\n",
+               (unsigned)n, t_lo, t_hi, t_hi / t_lo);
+        if (t_hi < t_lo) {
+            if (!found)
+                found = n;
+        } else {
+            found = 0;
+        }
+    }
+    printf("  threshold: %u\n\n", (unsigned)found);
+    return found;
+}
+
+int main(int argc, char **argv)
+{
+    int sqr;
+
+    if (argc > 1 && !strcmp(argv[1], "avx2"))
+        printf("AVX2 NTT: %s\n\n", bf_ntt_select() ? "yes" : "no");
+    bf_context_init(&ctx, tune_realloc, NULL);
+    tmp = malloc(sizeof(limb_t) * mp_mul_toom_tmp_size(4096));
+    for(sqr = 0; sqr < 2; sqr++) {
+        crossover("basecase vs karatsuba", ALGO_BASECASE, ALGO_KARATSUBA,
+                  8, 64, 4, sqr);
+        crossover("karatsuba vs toom3", ALGO_KARATSUBA, ALGO_TOOM3,
+                  32, 256, 8, sqr);
+        crossover("toom3 vs fft", ALGO_TOOM3, ALGO_FFT,
+                  64, 1024, 32, sqr);
+    }
+    free(tmp);
+    bf_context_end(&ctx);
+    return 0;
+}